@@ -25,6 +25,8 @@ from esphome.const import (
     STATE_CLASS_TOTAL_INCREASING,
     UNIT_AMPERE,
     UNIT_KILOWATT_HOURS,
+    UNIT_MILLISECOND,
+    UNIT_PERCENT,
     UNIT_VOLT,
     UNIT_WATT,
 )
@@ -32,7 +34,7 @@ from esphome.const import (
 from esphome.cpp_helpers import gpio_pin_expression
 
 DEPENDENCIES = ["uart"]
-AUTO_LOAD = ["binary_sensor", "sensor"]
+AUTO_LOAD = ["binary_sensor", "meter_bus", "sensor"]
 MULTI_CONF = True
 
 MAX_TARIFF_COUNT = 4
@@ -40,6 +42,14 @@ MAX_TARIFF_COUNT = 4
 CONF_ALL_COMMANDS = "all_commands"
 CONF_ENERGY = list(map(lambda x: "energy" + str(1 + x), range(0, MAX_TARIFF_COUNT)))
 CONF_ERROR = "error"
+CONF_LATENCY = "latency"
+CONF_ERROR_RATE = "error_rate"
+CONF_COUNTERS_INTERVAL = "counters_interval"
+CONF_RESPONSE_TIMEOUT = "response_timeout"
+CONF_ENERGY_DELTA = "energy_delta"
+CONF_AVERAGE_POWER = "average_power"
+CONF_ENERGY_THRESHOLD = "energy_threshold"
+CONF_STATUS_INTERVAL = "status_interval"
 
 mercury200_ns = cg.esphome_ns.namespace("mercury200")
 Mercury200 = mercury200_ns.class_("Mercury200", cg.PollingComponent, uart.UARTDevice)
@@ -50,6 +60,12 @@ SCHEMA_ATTRS = {
     cv.Optional(CONF_ALL_COMMANDS, default=False): cv.boolean,
     cv.Optional(CONF_DIR_PIN): pins.gpio_output_pin_schema,
     cv.Optional(CONF_STARTUP_DELAY, default="10s"): cv.positive_time_period_milliseconds,
+    cv.Optional(CONF_RESPONSE_TIMEOUT, default="300ms"): cv.All(
+        cv.positive_time_period_milliseconds, cv.Range(min=cv.TimePeriod(milliseconds=20), max=cv.TimePeriod(seconds=5))
+    ),
+    cv.Optional(CONF_ENERGY_THRESHOLD, default=0.0): cv.float_range(min=0.0, max=1000.0),
+    cv.Optional(CONF_COUNTERS_INTERVAL, default="0s"): cv.positive_time_period_milliseconds,
+    cv.Optional(CONF_STATUS_INTERVAL, default="0s"): cv.positive_time_period_milliseconds,
     cv.Optional(CONF_VOLTAGE): cv.maybe_simple_value(sensor.sensor_schema(
         unit_of_measurement=UNIT_VOLT,
         accuracy_decimals=1,
@@ -79,6 +95,29 @@ SCHEMA_ATTRS = {
         device_class=DEVICE_CLASS_PROBLEM,
         entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
     ), key=CONF_NAME),
+    cv.Optional(CONF_ENERGY_DELTA): cv.maybe_simple_value(sensor.sensor_schema(
+        unit_of_measurement=UNIT_KILOWATT_HOURS,
+        accuracy_decimals=2,
+        state_class=STATE_CLASS_MEASUREMENT,
+    ), key=CONF_NAME),
+    cv.Optional(CONF_AVERAGE_POWER): cv.maybe_simple_value(sensor.sensor_schema(
+        unit_of_measurement=UNIT_WATT,
+        accuracy_decimals=0,
+        device_class=DEVICE_CLASS_POWER,
+        state_class=STATE_CLASS_MEASUREMENT,
+    ), key=CONF_NAME),
+    cv.Optional(CONF_LATENCY): cv.maybe_simple_value(sensor.sensor_schema(
+        unit_of_measurement=UNIT_MILLISECOND,
+        accuracy_decimals=1,
+        state_class=STATE_CLASS_MEASUREMENT,
+        entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+    ), key=CONF_NAME),
+    cv.Optional(CONF_ERROR_RATE): cv.maybe_simple_value(sensor.sensor_schema(
+        unit_of_measurement=UNIT_PERCENT,
+        accuracy_decimals=1,
+        state_class=STATE_CLASS_MEASUREMENT,
+        entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+    ), key=CONF_NAME),
 }
 
 for conf_id in CONF_ENERGY:
@@ -98,6 +137,10 @@ async def to_code(config):
     var = cg.new_Pvariable(config[CONF_ID], uart_component, config[CONF_ADDRESS])
     cg.add(var.set_all_commands(config[CONF_ALL_COMMANDS]))
     cg.add(var.set_startup_delay(config[CONF_STARTUP_DELAY]))
+    cg.add(var.set_response_timeout(config[CONF_RESPONSE_TIMEOUT]))
+    cg.add(var.set_energy_threshold(round(config[CONF_ENERGY_THRESHOLD] * 100)))
+    cg.add(var.set_counters_interval(config[CONF_COUNTERS_INTERVAL]))
+    cg.add(var.set_status_interval(config[CONF_STATUS_INTERVAL]))
     await cg.register_component(var, config)
 
     if dir_pin_config := config.get(CONF_DIR_PIN):
@@ -120,6 +163,18 @@ async def to_code(config):
     if error_config := config.get(CONF_ERROR):
         sens = await binary_sensor.new_binary_sensor(error_config)
         cg.add(var.set_error_binary_sensor(sens))
+    if energy_delta_config := config.get(CONF_ENERGY_DELTA):
+        sens = await sensor.new_sensor(energy_delta_config)
+        cg.add(var.set_energy_delta_sensor(sens))
+    if average_power_config := config.get(CONF_AVERAGE_POWER):
+        sens = await sensor.new_sensor(average_power_config)
+        cg.add(var.set_average_power_sensor(sens))
+    if latency_config := config.get(CONF_LATENCY):
+        sens = await sensor.new_sensor(latency_config)
+        cg.add(var.set_latency_sensor(sens))
+    if error_rate_config := config.get(CONF_ERROR_RATE):
+        sens = await sensor.new_sensor(error_rate_config)
+        cg.add(var.set_error_rate_sensor(sens))
 
     for idx, conf_id in enumerate(CONF_ENERGY):
         if sens_config := config.get(conf_id):
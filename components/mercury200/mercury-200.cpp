@@ -5,7 +5,11 @@ namespace mercury200 {
 
 static const char *const TAG = "mercury200";
 
-Mercury200::Mercury200(uart::UARTComponent *uart, uint32_t address) : uart::UARTDevice(uart), address_(address) {
+#define PHASE_LENGTH 5
+#define MAX_PHASES_PER_LOOP 8
+#define INTER_BYTE_CHARS 4
+
+Mercury200::Mercury200(uart::UARTComponent *uart, uint32_t address) : uart::UARTDevice(uart), address_(address), transaction_(uart) {
   for (uint8_t i = 0; i < MAX_TARIFF_COUNT; i++)
     this->sensor_energy_[i] = nullptr;
 }
@@ -15,31 +19,41 @@ void Mercury200::setup() {
   if (this->dir_pin_) {
     this->dir_pin_->setup();
     this->dir_pin_->digital_write(false);
+    this->transaction_.set_dir_pin(this->dir_pin_);
   }
+  // response is sent without pauses: silence after its first byte means that meter won't send the rest
+  this->transaction_.set_inter_byte_chars(INTER_BYTE_CHARS);
   // read old unknown/unused data
   while (this->available())
     this->read();
 
-  // commands
+  // commands: identity is read once, others after their intervals (0 - every update)
   if (this->all_commands_) {
-    this->commands_.push_back(new GetSerialNumberCommand([this](uint32_t addr) { ESP_LOGD(TAG, "Serial number: %d", addr); }));
-    this->commands_.push_back(new GetVersionCommand(
-        [this](uint16_t ver, uint32_t data_ver) { ESP_LOGD(TAG, "Version: %d.%d (%06x)", (ver >> 8) & 0xff, ver & 0xff, data_ver); }));
-    this->commands_.push_back(new GetDateFabricCommand(
-        [this](uint8_t day, uint8_t month, uint16_t year) { ESP_LOGD(TAG, "DateFabric: %d.%d.%d", day, month, year); }));
-    this->commands_.push_back(new GetTimeCommand([this](uint32_t tm) { ESP_LOGD(TAG, "Time: %d", tm); }));
-    this->commands_.push_back(new GetLastTurnOffCommand([this](uint32_t tm) { ESP_LOGD(TAG, "LastTurnOff: %d", tm); }));
-    this->commands_.push_back(new GetLastTurnOnCommand([this](uint32_t tm) { ESP_LOGD(TAG, "LastTurnOn: %d", tm); }));
-    this->commands_.push_back(new GetTarifsCountCommand([this](uint8_t count) { ESP_LOGD(TAG, "TarifsCount: %d", count); }));
+    this->add_command(new GetSerialNumberCommand([this](uint32_t addr) { ESP_LOGD(TAG, "Serial number: %d", addr); }),
+                      INTERVAL_ONCE, PRIORITY_SLOW);
+    this->add_command(new GetVersionCommand(
+        [this](uint16_t ver, uint32_t data_ver) { ESP_LOGD(TAG, "Version: %d.%d (%06x)", (ver >> 8) & 0xff, ver & 0xff, data_ver); }),
+        INTERVAL_ONCE, PRIORITY_SLOW);
+    this->add_command(new GetDateFabricCommand(
+        [this](uint8_t day, uint8_t month, uint16_t year) { ESP_LOGD(TAG, "DateFabric: %d.%d.%d", day, month, year); }),
+        INTERVAL_ONCE, PRIORITY_SLOW);
+    this->add_command(new GetTimeCommand([this](uint32_t tm) { ESP_LOGD(TAG, "Time: %d", tm); }),
+                      this->status_interval_, PRIORITY_SLOW);
+    this->add_command(new GetLastTurnOffCommand([this](uint32_t tm) { ESP_LOGD(TAG, "LastTurnOff: %d", tm); }),
+                      this->status_interval_, PRIORITY_SLOW);
+    this->add_command(new GetLastTurnOnCommand([this](uint32_t tm) { ESP_LOGD(TAG, "LastTurnOn: %d", tm); }),
+                      this->status_interval_, PRIORITY_SLOW);
+    this->add_command(new GetTarifsCountCommand([this](uint8_t count) { ESP_LOGD(TAG, "TarifsCount: %d", count); }),
+                      INTERVAL_ONCE, PRIORITY_SLOW);
   }
   if (this->all_commands_ || this->sensor_battery_)
-    this->commands_.push_back(new GetBatteryCommand([this](float voltage) {
+    this->add_command(new GetBatteryCommand([this](float voltage) {
       ESP_LOGD(TAG, "Battery: %.2f", voltage);
       if (this->sensor_battery_)
         this->sensor_battery_->publish_state(voltage);
-    }));
+    }), this->status_interval_, PRIORITY_SLOW);
   if (this->all_commands_ || this->sensor_voltage_ || this->sensor_current_ || this->sensor_power_)
-    this->commands_.push_back(new GetUIPCommand([this](float v, float i, uint32_t p) {
+    this->add_command(new GetUIPCommand([this](float v, float i, uint32_t p) {
       ESP_LOGD(TAG, "U.I.P.: %.1f, %.2f, %d", v, i, p);
       if (this->sensor_voltage_)
         this->sensor_voltage_->publish_state(v);
@@ -47,14 +61,12 @@ void Mercury200::setup() {
         this->sensor_current_->publish_state(i);
       if (this->sensor_power_)
         this->sensor_power_->publish_state(p);
-    }));
-  this->commands_.push_back(new GetCountersCommand([this](float t1, float t2, float t3, float t4) {
-    ESP_LOGD(TAG, "Counters: %.2f, %.2f, %.2f, %.2f", t1, t2, t3, t4);
-    float *arr[MAX_TARIFF_COUNT] = {&t1, &t2, &t3, &t4};
-    for (uint8_t i = 0; i < MAX_TARIFF_COUNT; i++)
-      if (this->sensor_energy_[i])
-        this->sensor_energy_[i]->publish_state(*(arr[i]));
-  }));
+    }), 0, PRIORITY_FAST);
+  this->add_command(new GetCountersCommand([this](const uint32_t *counters) { this->process_counters(counters); }),
+                    this->counters_interval_, PRIORITY_NORMAL);
+  // higher priority first, in order of adding within the same priority
+  std::stable_sort(this->commands_.begin(), this->commands_.end(),
+                   [](Command *a, Command *b) { return a->priority() > b->priority(); });
   // startup delay
   delay(this->startup_delay_);
 }
@@ -62,6 +74,7 @@ void Mercury200::setup() {
 void Mercury200::dump_config() {
   ESP_LOGCONFIG(TAG, "Mercury 200.02 '%d'", this->address_);
   ESP_LOGCONFIG(TAG, "  All Commands: %s", this->all_commands_ ? "yes" : "no");
+  ESP_LOGCONFIG(TAG, "  Counters Interval: %u ms, Status Interval: %u ms", this->counters_interval_, this->status_interval_);
   if (this->dir_pin_) {
     LOG_PIN("  Direction Pin: ", this->dir_pin_);
   } else {
@@ -80,90 +93,125 @@ void Mercury200::dump_config() {
     LOG_SENSOR("  ", "Battery Sensor", this->sensor_battery_);
   if (this->sensor_error_)
     LOG_BINARY_SENSOR("  ", "Error Sensor", this->sensor_error_);
+  if (this->sensor_energy_delta_)
+    LOG_SENSOR("  ", "Energy Delta Sensor", this->sensor_energy_delta_);
+  if (this->sensor_average_power_)
+    LOG_SENSOR("  ", "Average Power Sensor", this->sensor_average_power_);
+  ESP_LOGCONFIG(TAG, "  Energy Threshold: %.2f kWh", this->energy_threshold_ / 100.0f);
+  if (this->sensor_latency_)
+    LOG_SENSOR("  ", "Latency Sensor", this->sensor_latency_);
+  if (this->sensor_error_rate_)
+    LOG_SENSOR("  ", "Error Rate Sensor", this->sensor_error_rate_);
   ESP_LOGCONFIG(TAG, "  Startup Delay: %d", this->startup_delay_);
+  ESP_LOGCONFIG(TAG, "  Response Timeout: %d", this->response_timeout_);
   LOG_UPDATE_INTERVAL(this);
 }
 
 void Mercury200::loop() {
+  // phases which don't wait for anything are run one after another in the same loop
+  for (uint8_t i = 0; i < MAX_PHASES_PER_LOOP; i++) {
+    uint32_t phase = this->phase_;
+    this->run_phase();
+    if (this->phase_ == phase || this->phase_ == 0)
+      break;
+  }
+}
+
+/* called by transaction for every received byte: response of command has fixed size */
+bool Mercury200::receive_byte(uint8_t c) {
+  // CRC is calculated while response is received (all bytes except CRC itself)
+  if (this->rx_bytes_received_ + 2 < this->rx_bytes_needed_)
+    this->rx_crc_.update(c);
+  this->rx_buffer_[this->rx_bytes_received_++] = c;
+  return this->rx_bytes_received_ >= this->rx_bytes_needed_;
+}
+
+void Mercury200::run_phase() {
   if (this->phase_ == 0 || this->sleep_time_ > millis())
     return;
 
-  uint32_t phase = this->phase_ % 8;
-  uint32_t cmd_idx = this->phase_ / 8;
+  uint32_t phase = this->phase_ % PHASE_LENGTH;
+  uint32_t cmd_idx = this->phase_ / PHASE_LENGTH;
   if (cmd_idx >= this->commands_.size() || this->error_) {
     this->phase_ = 0;
+    this->transaction_.release_bus();
     if (this->sensor_error_)
       this->sensor_error_->publish_state(this->error_);
+    this->publish_stats();
     return;
   }
 
   switch (phase) {
 
-  case 1: { // preparing command data
+  case 1: { // preparing command data and sending it
+    // commands with interval which is not passed yet are skipped
+    if (!this->commands_[cmd_idx]->is_due(millis(), this->get_update_interval() / 2)) {
+      ESP_LOGV(TAG, "Skip command 0x%02x until its interval", this->commands_[cmd_idx]->code());
+      this->phase_ += PHASE_LENGTH;
+      return;
+    }
+    // meters on the same UART send their commands in turns
+    if (!this->transaction_.acquire_bus())
+      return;
     uint32_t adr = this->address_ % 1000000;
     this->tx_buffer_[0] = (uint8_t)((adr >> 24) & 0xff);
     this->tx_buffer_[1] = (uint8_t)((adr >> 16) & 0xff);
     this->tx_buffer_[2] = (uint8_t)((adr >> 8) & 0xff);
     this->tx_buffer_[3] = (uint8_t)(adr & 0xff);
     this->tx_buffer_[4] = this->commands_[cmd_idx]->code();
-    uint16_t crc = crc16(this->tx_buffer_, 5);
+    uint16_t crc = meter_bus::Crc16Modbus::process(0xffff, this->tx_buffer_, 5);
     this->tx_buffer_[5] = crc & 0xff;
     this->tx_buffer_[6] = (crc >> 8) & 0xff;
     this->rx_bytes_needed_ = 7 + this->commands_[cmd_idx]->data_size();
     this->rx_bytes_received_ = 0;
-    this->wait_time_ = millis() + 1000; // timeout 1000 ms
-  } break;
-
-  case 2: { // set dir_pin to state SEND
-    if (this->dir_pin_) {
-      ESP_LOGV(TAG, "Set dir_pin to state SEND");
-      this->dir_pin_->digital_write(true);
-      delay(5);
-    }
-  } break;
-
-  case 3: { // sending command data
+    this->rx_crc_.reset();
     ESP_LOGV(TAG, "Sending command 0x%02x", this->commands_[cmd_idx]->code());
-    this->write_array(this->tx_buffer_, 7);
-    this->flush();
-    delay(5);
-  } break;
-
-  case 4: { // delay after command sent
-    if (this->dir_pin_) {
-      this->dir_pin_->digital_write(false);
-      ESP_LOGV(TAG, "Set dir_pin to state RECV");
-    }
+    this->transaction_.start(this->tx_buffer_, 7, this->response_timeout_, this);
   } break;
 
-  case 5: { // receiving data
-    while (this->available() && this->rx_bytes_received_ < this->rx_bytes_needed_)
-      this->rx_buffer_[this->rx_bytes_received_++] = this->read();
-    if (this->rx_bytes_received_ < this->rx_bytes_needed_) {
-      if (this->wait_time_ < millis()) {
+  case 2: { // waiting until command is sent and response is received
+    meter_bus::TransactionStatus status = this->transaction_.poll();
+    if (status == meter_bus::TRANSACTION_BUSY)
+      return;
+    // response is received: next meter can send its command while this one is validated
+    this->transaction_.release_bus();
+    this->stats_.requests++;
+    if (status == meter_bus::TRANSACTION_TIMEOUT) {
+      if (this->rx_bytes_received_ == 0) {
         ESP_LOGD(TAG, "Timed out command 0x%02x", this->commands_[cmd_idx]->code());
-        this->error_ = true;
-        this->phase_ += 2; // skip two next phases (validating and processing)
+      } else if (this->rx_bytes_received_ >= 7 &&
+                 meter_bus::Crc16Modbus::process(0xffff, this->rx_buffer_, this->rx_bytes_received_) == 0) {
+        // complete frame with valid checksum, but shorter than expected response
+        ESP_LOGD(TAG, "Command 0x%02x rejected: short response (%d of %d bytes)", this->commands_[cmd_idx]->code(),
+                 this->rx_bytes_received_, this->rx_bytes_needed_);
       } else {
-        ESP_LOGV(TAG, "Waiting next %d bytes", this->rx_bytes_needed_ - this->rx_bytes_received_);
-        return;
+        ESP_LOGD(TAG, "Incomplete response (%d of %d bytes) to command 0x%02x", this->rx_bytes_received_,
+                 this->rx_bytes_needed_, this->commands_[cmd_idx]->code());
       }
+      this->stats_.errors++;
+      this->error_ = true;
+      this->phase_ += 2; // skip two next phases (validating and processing)
     }
   } break;
 
-  case 6: { // validating data
+  case 3: { // validating data
     uint16_t recv_crc = ((uint16_t)this->rx_buffer_[this->rx_bytes_needed_ - 1] << 8) | this->rx_buffer_[this->rx_bytes_needed_ - 2];
-    uint16_t calc_crc = crc16(this->rx_buffer_, this->rx_bytes_needed_ - 2);
+    uint16_t calc_crc = this->rx_crc_.value();
     if (recv_crc != calc_crc) {
       ESP_LOGD(TAG, "Bad checksum (0x%04x instead of 0x%04x)", recv_crc, calc_crc);
+      this->stats_.errors++;
       this->error_ = true;
       this->phase_++;
     }
   } break;
 
-  case 7: { // processing command
+  case 4: { // processing command
+    this->stats_.cycle_time += this->transaction_.get_duration();
+    this->stats_.cycle_max_time = std::max(this->stats_.cycle_max_time, this->transaction_.get_duration());
+    this->stats_.cycle_responses++;
     ESP_LOGV(TAG, "Processing command 0x%02x", this->rx_buffer_[4]);
     this->commands_[cmd_idx]->process(this->rx_buffer_ + 5);
+    this->commands_[cmd_idx]->set_done(millis());
   } break;
 
   } // end case
@@ -171,33 +219,67 @@ void Mercury200::loop() {
   this->phase_++;
 }
 
+/* counters are kept in fixed point as read from meter, so consumption between reads has no float rounding;
+   counter is published when it has changed at least by threshold since last published value */
+void Mercury200::process_counters(const uint32_t *counters) {
+  uint32_t now = millis(), total = 0;
+  ESP_LOGD(TAG, "Counters: %.2f, %.2f, %.2f, %.2f", counters[0] / 100.0f, counters[1] / 100.0f, counters[2] / 100.0f,
+           counters[3] / 100.0f);
+  for (uint8_t i = 0; i < MAX_TARIFF_COUNT; i++) {
+    total += counters[i];
+    uint32_t change = counters[i] > this->published_counters_[i] ? counters[i] - this->published_counters_[i]
+                                                                   : this->published_counters_[i] - counters[i];
+    if (!this->counters_valid_ || (change > 0 && change >= this->energy_threshold_)) {
+      if (this->sensor_energy_[i])
+        this->sensor_energy_[i]->publish_state(counters[i] / 100.0f);
+      this->published_counters_[i] = counters[i];
+    }
+  }
+
+  if (this->counters_valid_ && total < this->counters_total_) {
+    ESP_LOGW(TAG, "Counters decreased (meter was reset or replaced), consumption is not calculated");
+  } else if (this->counters_valid_) {
+    // consumption since previous read and average power over that period (0.01 kWh = 10 Wh)
+    uint32_t delta = total - this->counters_total_, period = now - this->counters_time_;
+    if (delta != 0 || this->last_delta_ != 0) {
+      if (this->sensor_energy_delta_)
+        this->sensor_energy_delta_->publish_state(delta / 100.0f);
+      if (this->sensor_average_power_ && period > 0)
+        this->sensor_average_power_->publish_state(delta * 10.0f * 3600000.0f / period);
+    }
+    this->last_delta_ = delta;
+  }
+  this->counters_total_ = total;
+  this->counters_time_ = now;
+  this->counters_valid_ = true;
+}
+
+void Mercury200::add_command(Command *command, uint32_t interval, CommandPriority priority) {
+  command->set_schedule(interval, priority);
+  this->commands_.push_back(command);
+}
+
 void Mercury200::update() {
   if (this->phase_ != 0) {
     ESP_LOGW(TAG, "Skip update() coz previous was not finished!");
   } else {
     ESP_LOGV(TAG, "Time to Update");
     this->error_ = false; // reset error
+    this->stats_.cycle_time = this->stats_.cycle_max_time = this->stats_.cycle_responses = 0;
     this->phase_ = 1;
   }
 }
 
-/*
-https://github.com/RocketFox2409/MercuryESPHome/blob/main/mercury/mercury-200.02.h
-*/
-uint16_t Mercury200::crc16(const uint8_t *data, uint16_t len) {
-  uint16_t crc = 0xFFFF;
-  while (len--) {
-    crc ^= *data++;
-    for (uint8_t i = 0; i < 8; i++) {
-      if ((crc & 0x01) != 0) {
-        crc >>= 1;
-        crc ^= 0xA001;
-      } else {
-        crc >>= 1;
-      }
-    }
-  }
-  return crc;
+/* latency is averaged over responses of last update, error rate is counted since boot */
+void Mercury200::publish_stats() {
+  float latency = this->stats_.cycle_responses ? this->stats_.cycle_time / 1000.0f / this->stats_.cycle_responses : NAN;
+  float error_rate = this->stats_.requests ? 100.0f * this->stats_.errors / this->stats_.requests : NAN;
+  ESP_LOGD(TAG, "Meter %u: latency %.1f ms (max %.1f ms), %u errors of %u requests", this->address_, latency,
+           this->stats_.cycle_max_time / 1000.0f, this->stats_.errors, this->stats_.requests);
+  if (this->sensor_latency_ && !std::isnan(latency))
+    this->sensor_latency_->publish_state(latency);
+  if (this->sensor_error_rate_ && !std::isnan(error_rate))
+    this->sensor_error_rate_->publish_state(error_rate);
 }
 
 uint16_t Command::bcd16(const uint8_t *data, uint8_t len) {
@@ -1,10 +1,13 @@
 #pragma once
 
 #include "esphome/components/binary_sensor/binary_sensor.h"
+#include "esphome/components/meter_bus/checksum.h"
+#include "esphome/components/meter_bus/meter_bus.h"
 #include "esphome/components/sensor/sensor.h"
 #include "esphome/components/uart/uart.h"
 #include "esphome/core/component.h"
 #include "time.h"
+#include <algorithm>
 
 namespace esphome {
 namespace mercury200 {
@@ -12,6 +15,14 @@ namespace mercury200 {
 #define MAX_TARIFF_COUNT 4
 #define TX_BUFFER_SIZE 7 + 1
 #define RX_BUFFER_SIZE 7 + 16
+#define INTERVAL_ONCE UINT32_MAX  /* command is sent only until first successful response */
+
+/* commands of higher priority are sent first in every update */
+enum CommandPriority : uint8_t {
+  PRIORITY_SLOW = 0,    /* identity, battery, clock */
+  PRIORITY_NORMAL = 1,  /* energy counters */
+  PRIORITY_FAST = 2,    /* voltage, current, power */
+};
 
 class Command {
 public:
@@ -19,6 +30,23 @@ public:
   uint8_t code() { return this->code_; }
   uint8_t data_size() { return this->data_size_; }
   virtual void process(const uint8_t *data) = 0;
+  void set_schedule(uint32_t interval, CommandPriority priority) {
+    this->interval_ = interval;
+    this->priority_ = priority;
+  }
+  CommandPriority priority() { return this->priority_; }
+  /* interval since last successful response is passed; `slack` absorbs jitter of update() calls */
+  bool is_due(uint32_t now, uint32_t slack) {
+    if (!this->done_)
+      return true;
+    if (this->interval_ == INTERVAL_ONCE)
+      return false;
+    return now - this->last_time_ + slack >= this->interval_;
+  }
+  void set_done(uint32_t now) {
+    this->done_ = true;
+    this->last_time_ = now;
+  }
   static uint8_t bcd(const uint8_t data) { return (data & 0x0f) + 10 * ((data >> 4) & 0x0f); };
   static uint16_t bcd16(const uint8_t *data, uint8_t len = 2);
   static uint32_t bcd32(const uint8_t *data, uint8_t len = 4);
@@ -30,6 +58,9 @@ public:
 
 protected:
   uint8_t code_, data_size_;
+  uint32_t interval_{0}, last_time_{0};
+  CommandPriority priority_{PRIORITY_NORMAL};
+  bool done_{false};
 };
 
 class GetSerialNumberCommand : public Command {
@@ -97,22 +128,35 @@ public:
 
 class GetCountersCommand : public Command {
 public:
-  GetCountersCommand(std::function<void(float, float, float, float)> on_value) : Command(0x27, 16), on_value_(on_value) {}
+  /* counters of tariffs in 0.01 kWh exactly as they are kept by meter */
+  GetCountersCommand(std::function<void(const uint32_t *)> on_value) : Command(0x27, 16), on_value_(on_value) {}
   void process(const uint8_t *data) override {
-    on_value_((float)bcd32(data) / 100, (float)bcd32(data + 4) / 100, (float)bcd32(data + 8) / 100, (float)bcd32(data + 12) / 100);
+    uint32_t counters[MAX_TARIFF_COUNT] = {bcd32(data), bcd32(data + 4), bcd32(data + 8), bcd32(data + 12)};
+    on_value_(counters);
   }
-  std::function<void(float t1, float t2, float t3, float t4)> on_value_;
+  std::function<void(const uint32_t *counters)> on_value_;
 };
 
-class Mercury200 : public PollingComponent, public uart::UARTDevice {
+/* exchanges with meter: errors and requests since boot, response times of last update */
+typedef struct {
+  uint32_t requests, errors;
+  uint32_t cycle_time, cycle_max_time;  /* microseconds */
+  uint16_t cycle_responses;
+} stats_t;
+
+class Mercury200 : public PollingComponent, public uart::UARTDevice, public meter_bus::FrameReceiver {
 public:
   Mercury200(uart::UARTComponent *uart, uint32_t address);
   void setup() override;
   void dump_config() override;
   void loop() override;
   void update() override;
+  bool receive_byte(uint8_t c) override;
   void set_all_commands(bool all_commands) { this->all_commands_ = all_commands; }
   void set_startup_delay(uint32_t startup_delay) { this->startup_delay_ = startup_delay; }
+  void set_response_timeout(uint32_t timeout) { this->response_timeout_ = timeout; }
+  void set_counters_interval(uint32_t interval) { this->counters_interval_ = interval; }
+  void set_status_interval(uint32_t interval) { this->status_interval_ = interval; }
   void set_dir_pin(GPIOPin *pin) { this->dir_pin_ = pin; }
   void set_voltage_sensor(sensor::Sensor *sensor) { this->sensor_voltage_ = sensor; }
   void set_current_sensor(sensor::Sensor *sensor) { this->sensor_current_ = sensor; }
@@ -120,22 +164,40 @@ public:
   void set_battery_voltage_sensor(sensor::Sensor *sensor) { this->sensor_battery_ = sensor; }
   void set_error_binary_sensor(binary_sensor::BinarySensor *sensor) { this->sensor_error_ = sensor; }
   void set_energy_sensor(uint16_t idx, sensor::Sensor *sensor) { this->sensor_energy_[idx] = sensor; }
+  void set_energy_delta_sensor(sensor::Sensor *sensor) { this->sensor_energy_delta_ = sensor; }
+  void set_average_power_sensor(sensor::Sensor *sensor) { this->sensor_average_power_ = sensor; }
+  void set_energy_threshold(uint32_t threshold) { this->energy_threshold_ = threshold; }
+  void set_latency_sensor(sensor::Sensor *sensor) { this->sensor_latency_ = sensor; }
+  void set_error_rate_sensor(sensor::Sensor *sensor) { this->sensor_error_rate_ = sensor; }
 
 protected:
   void delay(uint32_t ms) { this->sleep_time_ = millis() + ms; }
-  uint16_t crc16(const uint8_t *data, uint16_t len);
+  void run_phase();
+  void add_command(Command *command, uint32_t interval, CommandPriority priority);
+  void publish_stats();
+  void process_counters(const uint32_t *counters);
   std::vector<Command *> commands_;
 
 private:
   uint32_t address_, startup_delay_{0}, phase_{0};
-  unsigned long sleep_time_{0}, wait_time_{0};
+  uint32_t counters_interval_{0}, status_interval_{0}, response_timeout_{1000};
+  unsigned long sleep_time_{0};
   uint8_t tx_buffer_[TX_BUFFER_SIZE], rx_buffer_[RX_BUFFER_SIZE];
   uint16_t rx_bytes_needed_{0}, rx_bytes_received_{0};
   bool all_commands_, error_{false};
   GPIOPin *dir_pin_{nullptr};
+  meter_bus::Transaction transaction_;
+  meter_bus::Crc16Modbus rx_crc_;
   binary_sensor::BinarySensor *sensor_error_{nullptr};
   sensor::Sensor *sensor_voltage_{nullptr}, *sensor_current_{nullptr}, *sensor_power_{nullptr}, *sensor_battery_{nullptr};
   sensor::Sensor *sensor_energy_[MAX_TARIFF_COUNT];
+  sensor::Sensor *sensor_energy_delta_{nullptr}, *sensor_average_power_{nullptr};
+  sensor::Sensor *sensor_latency_{nullptr}, *sensor_error_rate_{nullptr};
+  /* in 0.01 kWh: last published counters, sum of last read counters and threshold of publishing */
+  uint32_t published_counters_[MAX_TARIFF_COUNT]{};
+  uint32_t counters_total_{0}, counters_time_{0}, last_delta_{0}, energy_threshold_{0};
+  bool counters_valid_{false};
+  stats_t stats_{};
 };
 
 } // namespace mercury200
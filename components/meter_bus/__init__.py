@@ -0,0 +1,2 @@
+CODEOWNERS = ["@dvb666"]
+DEPENDENCIES = ["uart"]
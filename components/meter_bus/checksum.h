@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace meter_bus {
+
+#define CRC16_X25_POLY      0x8408  /* HDLC FCS/HCS: reflected 0x1021, init 0xffff, result xor'ed with 0xffff */
+#define CRC16_MODBUS_POLY   0xA001  /* Mercury: reflected 0x8005, init 0xffff */
+
+/* lookup tables of reflected CRC-16 generated at compile time: t[0] is classic byte table,
+   t[k] gives CRC of byte followed by k zero bytes (for processing SLICES bytes per step) */
+template<uint16_t POLY, uint8_t SLICES> struct Crc16Table {
+  uint16_t t[SLICES][256];
+  constexpr Crc16Table() : t() {
+    for (uint16_t i = 0; i < 256; i++) {
+      uint16_t crc = i;
+      for (uint8_t bit = 0; bit < 8; bit++)
+        crc = (crc & 0x01) ? (crc >> 1) ^ POLY : crc >> 1;
+      t[0][i] = crc;
+    }
+    for (uint8_t k = 1; k < SLICES; k++)
+      for (uint16_t i = 0; i < 256; i++)
+        t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+  }
+};
+
+/* reflected CRC-16: fed byte by byte while frame is received (so it is ready when last byte arrives) or
+   by blocks; blocks are processed by SLICES bytes per step (1, 4 or 8; table takes SLICES * 512 bytes of flash) */
+template<uint16_t POLY, uint8_t SLICES = 4> class Crc16 {
+  static_assert(SLICES == 1 || SLICES == 4 || SLICES == 8, "CRC16 slicing must be 1, 4 or 8 bytes");
+
+ public:
+  explicit Crc16(uint16_t init = 0xffff) : init_(init), crc_(init) {}
+  void reset() { this->crc_ = this->init_; }
+  void update(uint8_t c) { this->crc_ = (this->crc_ >> 8) ^ TABLE.t[0][(this->crc_ ^ c) & 0xff]; }
+  void update(const uint8_t *data, size_t len) { this->crc_ = process(this->crc_, data, len); }
+  uint16_t value() const { return this->crc_; }
+
+  /* continue calculation from `crc` over next part of data */
+  static uint16_t process(uint16_t crc, const uint8_t *data, size_t len) {
+    if (SLICES > 1) {
+      for (; len >= SLICES; len -= SLICES, data += SLICES) {
+        crc ^= data[0] | (data[1] << 8);
+        uint16_t next = TABLE.t[SLICES - 1][crc & 0xff] ^ TABLE.t[SLICES - 2][crc >> 8];
+        for (uint8_t k = 2; k < SLICES; k++)
+          next ^= TABLE.t[SLICES - 1 - k][data[k]];
+        crc = next;
+      }
+    }
+    while (len--)
+      crc = (crc >> 8) ^ TABLE.t[0][(crc ^ *data++) & 0xff];
+    return crc;
+  }
+
+ protected:
+  static constexpr Crc16Table<POLY, SLICES> TABLE{};
+  uint16_t init_, crc_;
+};
+
+typedef Crc16<CRC16_X25_POLY> Crc16X25;
+typedef Crc16<CRC16_MODBUS_POLY> Crc16Modbus;
+
+/* additive checksum (sum of bytes modulo 256) used by CJ/T188 frames */
+class Sum8 {
+ public:
+  void reset() { this->sum_ = 0; }
+  void update(uint8_t c) { this->sum_ += c; }
+  void update(const uint8_t *data, size_t len) { this->sum_ = process(this->sum_, data, len); }
+  uint8_t value() const { return this->sum_; }
+
+  static uint8_t process(uint8_t sum, const uint8_t *data, size_t len) {
+    while (len--)
+      sum += *data++;
+    return sum;
+  }
+
+ protected:
+  uint8_t sum_{0};
+};
+
+}  // namespace meter_bus
+}  // namespace esphome
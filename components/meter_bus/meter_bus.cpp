@@ -0,0 +1,127 @@
+#include "meter_bus.h"
+#include <algorithm>
+
+namespace esphome {
+namespace meter_bus {
+
+std::map<uart::UARTComponent *, Transaction::bus_t> Transaction::buses_;
+
+void Transaction::start(const uint8_t *data, uint16_t size, uint32_t timeout, FrameReceiver *receiver) {
+  // time of one character: start bit, data bits, parity and stop bits
+  uint32_t bits = 1 + this->uart_->get_data_bits() + this->uart_->get_stop_bits() +
+                  (this->uart_->get_parity() != uart::UART_CONFIG_PARITY_NONE ? 1 : 0);
+  this->char_time_ = (bits * 1000000UL + this->uart_->get_baud_rate() - 1) / this->uart_->get_baud_rate();
+  this->inter_byte_timeout_ = std::max(this->inter_byte_chars_ * this->char_time_, (uint32_t) MIN_INTER_BYTE_TIMEOUT);
+  // stale bytes would be taken as beginning of response
+  uint8_t c;
+  for (uint16_t i = 0; i < MAX_DRAIN_BYTES && this->uart_->available() > 0; i++)
+    this->uart_->read_byte(&c);
+
+  this->data_ = data;
+  this->size_ = size;
+  this->timeout_ = timeout;
+  this->receiver_ = receiver;
+  this->start_time_ = micros();
+  this->high_freq_.start();
+  if (this->dir_pin_ != nullptr)
+    this->dir_pin_->digital_write(true);
+  this->set_state_(STATE_SEND);
+}
+
+void Transaction::receive_next(uint32_t timeout) {
+  this->timeout_ = timeout;
+  this->receive_time_ = millis();
+  this->received_ = 0;
+  this->start_time_ = micros();
+  this->high_freq_.start();
+  this->set_state_(STATE_RECEIVE);
+}
+
+TransactionStatus Transaction::poll() {
+  for (;;) {
+    switch (this->state_) {
+      case STATE_IDLE:
+        return TRANSACTION_IDLE;
+
+      case STATE_SEND:
+        // transceiver needs two characters time to switch to transmit
+        if (this->dir_pin_ != nullptr && micros() - this->state_time_ < 2 * this->char_time_)
+          return TRANSACTION_BUSY;
+        this->uart_->write_array(this->data_, this->size_);
+        this->set_state_(STATE_SENT);
+        break;
+
+      case STATE_SENT:
+        // direction can be switched only when all bytes with last stop bit left transceiver
+        if (this->dir_pin_ != nullptr) {
+          if (micros() - this->state_time_ < (this->size_ + 2) * this->char_time_)
+            return TRANSACTION_BUSY;
+          this->uart_->flush();
+          this->dir_pin_->digital_write(false);
+        }
+        if (this->receiver_ == nullptr)
+          return this->finish_(TRANSACTION_DONE);
+        this->receive_time_ = millis();
+        this->received_ = 0;
+        this->set_state_(STATE_RECEIVE);
+        break;
+
+      case STATE_RECEIVE: {
+        uint8_t c;
+        while (this->uart_->available() > 0 && this->uart_->read_byte(&c)) {
+          this->received_++;
+          this->last_byte_time_ = micros();
+          if (this->receiver_->receive_byte(c))
+            return this->finish_(TRANSACTION_DONE);
+        }
+        // meter which started to answer and stopped won't send the rest: no need to wait full timeout
+        if (this->inter_byte_chars_ > 0 && this->received_ > 0) {
+          if (micros() - this->last_byte_time_ > this->inter_byte_timeout_)
+            return this->finish_(TRANSACTION_TIMEOUT);
+        } else if (millis() - this->receive_time_ > this->timeout_) {
+          return this->finish_(TRANSACTION_TIMEOUT);
+        }
+        return TRANSACTION_BUSY;
+      }
+    }
+  }
+}
+
+TransactionStatus Transaction::finish_(TransactionStatus status) {
+  if (this->state_ != STATE_IDLE) {
+    this->duration_ = micros() - this->start_time_;
+    this->high_freq_.stop();
+  }
+  // transceiver must not be left driving the line when transaction is cancelled before request is sent out
+  if (this->dir_pin_ != nullptr && (this->state_ == STATE_SEND || this->state_ == STATE_SENT)) {
+    if (this->state_ == STATE_SENT)
+      this->uart_->flush();
+    this->dir_pin_->digital_write(false);
+  }
+  this->state_ = STATE_IDLE;
+  return status;
+}
+
+bool Transaction::acquire_bus() {
+  bus_t &bus = buses_[this->uart_];
+  if (bus.owner == this)
+    return true;
+  if (bus.owner == nullptr && (bus.waiting.empty() || bus.waiting.front() == this)) {
+    if (!bus.waiting.empty())
+      bus.waiting.pop_front();
+    bus.owner = this;
+    return true;
+  }
+  if (std::find(bus.waiting.begin(), bus.waiting.end(), this) == bus.waiting.end())
+    bus.waiting.push_back(this);
+  return false;
+}
+
+void Transaction::release_bus() {
+  bus_t &bus = buses_[this->uart_];
+  if (bus.owner == this)
+    bus.owner = nullptr;
+}
+
+}  // namespace meter_bus
+}  // namespace esphome
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "esphome/components/uart/uart.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+#include <deque>
+#include <map>
+
+namespace esphome {
+namespace meter_bus {
+
+#define MAX_DRAIN_BYTES 256     /* max stale bytes discarded before request */
+#define MIN_INTER_BYTE_TIMEOUT 20000  /* us: UART FIFO timeout and loop latency delay bytes at any baud rate */
+
+/* consumer of response: gets bytes as soon as they are read from UART */
+class FrameReceiver {
+ public:
+  /* returns true when frame is complete (or can't be received) */
+  virtual bool receive_byte(uint8_t c) = 0;
+};
+
+enum TransactionStatus : uint8_t {
+  TRANSACTION_IDLE,
+  TRANSACTION_BUSY,     /* waiting for guard time or response bytes */
+  TRANSACTION_DONE,     /* request sent and response received (or request without response sent) */
+  TRANSACTION_TIMEOUT
+};
+
+/* request/response exchange on half-duplex UART advanced by poll() without blocking; every step is done as soon
+   as its condition is met (bytes on the line are sent, guard time elapsed, response bytes available), guard times
+   are derived from baud rate and loop runs at high frequency while exchange is in progress */
+class Transaction {
+ public:
+  explicit Transaction(uart::UARTComponent *uart) : uart_(uart) {}
+  void set_dir_pin(GPIOPin *pin) { this->dir_pin_ = pin; }
+  /* response is complete (or broken) after silence of `chars` character times once its first byte is received;
+     0 - wait until receiver takes complete frame or timeout expires */
+  void set_inter_byte_chars(uint16_t chars) { this->inter_byte_chars_ = chars; }
+  /* request `data` must be valid until it is sent; `receiver` is nullptr for request without response;
+     `timeout` (ms) is waiting time for the first byte of response */
+  void start(const uint8_t *data, uint16_t size, uint32_t timeout, FrameReceiver *receiver);
+  /* receive next frame which meter sends without request */
+  void receive_next(uint32_t timeout);
+  TransactionStatus poll();
+  void cancel() { this->finish_(TRANSACTION_IDLE); }
+  bool is_busy() const { return this->state_ != STATE_IDLE; }
+  uint32_t get_char_time() const { return this->char_time_; }
+  /* microseconds from start of last exchange to its end */
+  uint32_t get_duration() const { return this->duration_; }
+  /* bytes of response received in last exchange, including ones dropped by receiver */
+  uint16_t get_received() const { return this->received_; }
+  /* meters sharing one UART take turns: owner keeps it from request until response is received,
+     waiting meters get it in order they asked for it */
+  bool acquire_bus();
+  void release_bus();
+
+ protected:
+  enum State : uint8_t { STATE_IDLE, STATE_SEND, STATE_SENT, STATE_RECEIVE };
+  void set_state_(State state) {
+    this->state_ = state;
+    this->state_time_ = micros();
+  }
+  TransactionStatus finish_(TransactionStatus status);
+
+  uart::UARTComponent *uart_;
+  GPIOPin *dir_pin_{nullptr};
+  FrameReceiver *receiver_{nullptr};
+  const uint8_t *data_{nullptr};
+  uint16_t size_{0};
+  State state_{STATE_IDLE};
+  uint32_t char_time_{0}, state_time_{0}, start_time_{0}, duration_{0};
+  uint32_t timeout_{0}, receive_time_{0};
+  uint32_t inter_byte_timeout_{0}, last_byte_time_{0};
+  uint16_t inter_byte_chars_{0}, received_{0};
+  HighFrequencyLoopRequester high_freq_;
+
+  typedef struct {
+    Transaction *owner;
+    std::deque<Transaction *> waiting;
+  } bus_t;
+  static std::map<uart::UARTComponent *, bus_t> buses_;
+};
+
+}  // namespace meter_bus
+}  // namespace esphome
@@ -1,5 +1,6 @@
 import esphome.codegen as cg
 import esphome.config_validation as cv
+from esphome.components import sensor
 from esphome.const import (
     CONF_ID,
     CONF_IP_ADDRESS,
@@ -7,13 +8,28 @@ from esphome.const import (
     CONF_ADDRESS,
     CONF_DELAY,
     CONF_TIMEOUT,
+    ENTITY_CATEGORY_DIAGNOSTIC,
+    STATE_CLASS_MEASUREMENT,
+    STATE_CLASS_TOTAL_INCREASING,
+    UNIT_MILLISECOND,
 )
 from esphome.core import CORE
 
-AUTO_LOAD = ["async_tcp"]
+AUTO_LOAD = ["async_tcp", "sensor"]
 MULTI_CONF = True
 
 CONF_RAW_DATA = "raw_data"
+CONF_MAX_IN_FLIGHT = "max_in_flight"
+CONF_REGISTER_GAP = "register_gap"
+CONF_MAX_CONNECTIONS = "max_connections"
+CONF_MAX_RECONNECT_DELAY = "max_reconnect_delay"
+CONF_TELEMETRY_INTERVAL = "telemetry_interval"
+CONF_RTT = "rtt"
+CONF_TIMEOUTS = "timeouts"
+CONF_RECONNECTS = "reconnects"
+CONF_BYTES_IN = "bytes_in"
+CONF_BYTES_OUT = "bytes_out"
+UNIT_BYTES = "B"
 
 modbus_tcp_ns = cg.esphome_ns.namespace("modbus_tcp")
 ModbusTcpComponent = modbus_tcp_ns.class_("ModbusTcpComponent", cg.Component)
@@ -28,6 +44,44 @@ CONFIG_SCHEMA = (
             cv.Optional(CONF_RAW_DATA, default=False): cv.boolean,
             cv.Optional(CONF_DELAY, default="100ms"): cv.positive_time_period_milliseconds,
             cv.Optional(CONF_TIMEOUT, default="5s"): cv.positive_time_period_milliseconds,
+            cv.Optional(CONF_MAX_IN_FLIGHT, default=1): cv.int_range(min=1, max=16),
+            cv.Optional(CONF_REGISTER_GAP, default=10): cv.int_range(min=0, max=124),
+            cv.Optional(CONF_MAX_CONNECTIONS): cv.int_range(min=0, max=16),
+            cv.Optional(CONF_MAX_RECONNECT_DELAY, default="60s"): cv.positive_time_period_milliseconds,
+            cv.Optional(CONF_TELEMETRY_INTERVAL, default="60s"): cv.positive_time_period_milliseconds,
+            cv.Optional(CONF_RTT): sensor.sensor_schema(
+                unit_of_measurement=UNIT_MILLISECOND,
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_MEASUREMENT,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+                icon="mdi:timer-outline",
+            ),
+            cv.Optional(CONF_TIMEOUTS): sensor.sensor_schema(
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_TOTAL_INCREASING,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+                icon="mdi:timer-alert-outline",
+            ),
+            cv.Optional(CONF_RECONNECTS): sensor.sensor_schema(
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_TOTAL_INCREASING,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+                icon="mdi:lan-disconnect",
+            ),
+            cv.Optional(CONF_BYTES_IN): sensor.sensor_schema(
+                unit_of_measurement=UNIT_BYTES,
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_TOTAL_INCREASING,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+                icon="mdi:download-network-outline",
+            ),
+            cv.Optional(CONF_BYTES_OUT): sensor.sensor_schema(
+                unit_of_measurement=UNIT_BYTES,
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_TOTAL_INCREASING,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+                icon="mdi:upload-network-outline",
+            ),
         }
     )
     .extend(cv.COMPONENT_SCHEMA)
@@ -38,5 +92,15 @@ async def to_code(config):
     await cg.register_component(var, config)
     cg.add(var.set_delay_after_connect(config[CONF_DELAY]))
     cg.add(var.set_timeout(config[CONF_TIMEOUT]))
+    cg.add(var.set_max_in_flight(config[CONF_MAX_IN_FLIGHT]))
+    cg.add(var.set_register_gap(config[CONF_REGISTER_GAP]))
+    if CONF_MAX_CONNECTIONS in config:
+        cg.add(var.set_max_connections(config[CONF_MAX_CONNECTIONS]))
+    cg.add(var.set_max_reconnect_delay(config[CONF_MAX_RECONNECT_DELAY]))
+    cg.add(var.set_telemetry_interval(config[CONF_TELEMETRY_INTERVAL]))
+    for key in [CONF_RTT, CONF_TIMEOUTS, CONF_RECONNECTS, CONF_BYTES_IN, CONF_BYTES_OUT]:
+        if key in config:
+            sens = await sensor.new_sensor(config[key])
+            cg.add(getattr(var, f"set_{key}_sensor")(sens))
     if config[CONF_RAW_DATA]:
         cg.add_define("USE_TCP_DEBUGGER")
\ No newline at end of file
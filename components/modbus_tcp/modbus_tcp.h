@@ -2,7 +2,14 @@
 
 #include "esphome/core/application.h"
 #include "esphome/core/component.h"
+#include "esphome/core/helpers.h"
 #include "esphome/core/log.h"
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
+#include <algorithm>
+#include <deque>
+#include <map>
 #include <queue>
 #include <vector>
 
@@ -21,22 +28,59 @@ namespace modbus_tcp {
 static const char *TAG = "modbus-tcp";
 
 #define PROTOCOL_ID 0x0000
-#define MAX_TX_BUFFER_SIZE 32
-#define MAX_RX_BUFFER_SIZE 64
+#define MAX_WRITE_REGISTERS 16  // max registers count for one write request (function 0x10)
+#define MAX_TX_BUFFER_SIZE (13 + 2 * MAX_WRITE_REGISTERS)
+#define MAX_ADU_SIZE 260  // MBAP header 7 bytes + max PDU 253 bytes
+#define MBAP_HEADER_SIZE 6
+#define MAX_READ_REGISTERS 125  // max registers count for one read request (function 0x03)
+#define POOL_HOLD_TIME 5000     // max time to hold pooled connection while other hosts are waiting for it
+#define RECONNECT_MIN_DELAY 1000
+#define RTT_BUCKETS_COUNT 6
+#define MAX_EXPIRED_TX_IDS 16   // timed out transactions remembered to recognize their late responses
+#define MAX_STALE_RESPONSES 3   // late or unknown responses in row after which connection is closed
+#define MAX_TIMEOUTS_IN_ROW 3   // timeouts without any response after which connection is closed
+
+// upper bounds (ms) of RTT histogram buckets, the last one is for everything else
+static const uint32_t RTT_BUCKETS[RTT_BUCKETS_COUNT] = {50, 100, 200, 500, 1000, UINT32_MAX};
 
 enum DebugDirection { DIRECTION_RX, DIRECTION_TX };
 
-typedef struct {
-  uint8_t function, response_code;
-  uint16_t data1 = 0, data2 = 0;
-  uint16_t phase = 0, tx_id = 0, length = 0;
-} ModbusTcpCommand;
-
 typedef std::function<void()> ModbusTcpOnConnect;
 typedef std::function<void()> ModbusTcpOnDisconnect;
 typedef std::function<void(uint8_t code, uint16_t error)> ModbusTcpOnError;
 typedef std::function<void(uint8_t code, uint8_t *data, uint16_t register_count)> ModbusTcpOnRegisterResponse;
 
+// result of registers range read, which was split to several requests
+typedef struct {
+  uint8_t response_code;
+  uint16_t first_register, registers_count, remaining;
+  bool failed = false;
+  uint8_t *data = nullptr;      // caller's buffer or `buffer` data
+  std::vector<uint8_t> buffer;  // used when caller's buffer was not provided
+  ModbusTcpOnRegisterResponse on_response{nullptr};  // used instead of on_register_response_ when set
+  std::vector<uint16_t> blocks;  // indexes of registers blocks read with this request
+} ModbusTcpReadResult;
+
+// registers block polled by scheduler with own interval
+typedef struct {
+  uint8_t unit_id, response_code;
+  uint16_t first_register, registers_count;
+  uint32_t interval;  // 0 - read only by request_register_blocks()
+  unsigned long next_time;
+  ModbusTcpOnRegisterResponse on_response;
+  bool outstanding = false;  // read is queued or in flight
+} ModbusTcpRegisterBlock;
+
+typedef struct {
+  uint8_t unit_id, function, response_code;
+  uint16_t data1 = 0, data2 = 0;
+  uint16_t tx_id = 0, length = 0;
+  unsigned long send_time = 0, timeout_time = 0;
+  bool must_deliver = false;  // keep command in queue on reconnect
+  std::vector<uint16_t> values;  // registers values for write multiple registers (function 0x10)
+  std::shared_ptr<ModbusTcpReadResult> result{nullptr};
+} ModbusTcpCommand;
+
 class ModbusTcpComponent : public Component {
  public:
   ModbusTcpComponent(const std::string &ip_address, uint16_t port, uint8_t address)
@@ -50,32 +94,79 @@ class ModbusTcpComponent : public Component {
     client_->onConnect([this](void *arg, AsyncClient *client) { on_connect(client); });
     client_->onDisconnect([this](void *arg, AsyncClient *client) { on_disconnect(client); });
     client_->onData([this](void *arg, AsyncClient *client, void *data, size_t len) { on_data(client, data, len); });
+    if (telemetry_interval_ > 0)
+      set_interval("telemetry", telemetry_interval_, [this]() { publish_telemetry(); });
     start();
   };
 
   void loop() override {
-    unsigned long current_time;
-    if (this->sleep_time_ != 0 && this->sleep_time_ > (current_time = millis()))
+    // validate and dispatch all responses framed by on_data() since previous loop
+    process_responses();
+
+    unsigned long current_time = millis();
+    if (this->sleep_time_ != 0 && this->sleep_time_ > current_time)
       return;
     else if (this->sleep_time_ != 0)
       this->sleep_time_ = 0;
 
     // check if need to connect
     if (!connecting_ && !connected_ && can_connect_) {
-      connect();
+      if (acquire_connection(current_time))
+        connect();
+      return;
     }
-    // check if we have next command
-    else if (connected_ && !commands_queue_.empty()) {
-      auto &command = this->commands_queue_.front();
-      if (command == nullptr || this->process_command(command.get())) {
-        this->commands_queue_.pop();
+    if (!connected_)
+      return;
+
+    // add reads of due registers blocks
+    schedule_register_blocks(current_time);
+
+    // give pooled connection to other waiting host
+    if (holding_connection_ && !waiting_.empty() && in_flight_.empty() &&
+        (!has_commands() || connected_time_ + POOL_HOLD_TIME < current_time)) {
+      ESP_LOGD(TAG, "Releasing connection for other host");
+      released_ = releasing_ = true;
+      client_->close(true);
+      return;
+    }
+
+    // expire timed out transactions, other transactions in flight keep waiting for their responses
+    for (auto it = in_flight_.begin(); it != in_flight_.end();) {
+      if ((*it)->timeout_time < current_time) {
+        auto command = std::move(*it);
+        it = in_flight_.erase(it);
+        expire_command(command.get());
+      } else {
+        it++;
       }
     }
+    // host doesn't answer at all, so connection is probably broken
+    if (timeouts_in_row_ >= MAX_TIMEOUTS_IN_ROW) {
+      ESP_LOGW(TAG, "No responses for %d transactions. Closing connection", timeouts_in_row_);
+      client_->stop();
+      return;
+    }
+
+    // send next commands while transactions window is not full
+    while (connected_ && has_commands() && in_flight_.size() < max_in_flight_) {
+      auto command = pop_command();
+      if (command != nullptr && send_command(command.get()))
+        this->in_flight_.push_back(std::move(command));
+    }
   };
 
   void dump_config() override {
     ESP_LOGCONFIG(TAG, "Modbus TCP: %s:%d", ip_address_.c_str(), port_);
     ESP_LOGCONFIG(TAG, "  Address: %d", address_);
+    ESP_LOGCONFIG(TAG, "  Max In Flight: %d", max_in_flight_);
+    ESP_LOGCONFIG(TAG, "  Register Gap: %d", register_gap_);
+    ESP_LOGCONFIG(TAG, "  Max Reconnect Delay: %u ms", max_reconnect_delay_);
+    if (max_connections_ > 0)
+      ESP_LOGCONFIG(TAG, "  Max Connections (all hosts): %d", max_connections_);
+    for (auto &block : register_blocks_)
+      ESP_LOGCONFIG(TAG, "  Registers Block: unit %d, 0x%04x-0x%04x, interval %u ms, code 0x%02X", block.unit_id,
+                    block.first_register, block.first_register + block.registers_count - 1, block.interval,
+                    block.response_code);
   };
 
   void on_shutdown() override {
@@ -92,6 +183,15 @@ class ModbusTcpComponent : public Component {
     ESP_LOGD(TAG, "Stopping");
     can_connect_ = false;
     connect_attempt_ = 0;
+    auto it = std::find(waiting_.begin(), waiting_.end(), this);
+    if (it != waiting_.end())
+      waiting_.erase(it);
+    releasing_ = false;
+    if (released_ && !connected_ && !connecting_) {
+      finish_release();
+      return;
+    }
+    released_ = false;
     client_->stop();
   }
 
@@ -100,77 +200,330 @@ class ModbusTcpComponent : public Component {
   void set_address(uint8_t address) { address_ = address; }
   void set_delay_after_connect(uint32_t ms) { delay_after_connect_ = ms; }
   void set_timeout(uint32_t ms) { timeout_ = ms; }
+  void set_max_reconnect_delay(uint32_t ms) { max_reconnect_delay_ = std::max(ms, (uint32_t) RECONNECT_MIN_DELAY); }
+  void set_telemetry_interval(uint32_t ms) { telemetry_interval_ = ms; }
+#ifdef USE_SENSOR
+  void set_rtt_sensor(sensor::Sensor *sensor) { rtt_sensor_ = sensor; }
+  void set_timeouts_sensor(sensor::Sensor *sensor) { timeouts_sensor_ = sensor; }
+  void set_reconnects_sensor(sensor::Sensor *sensor) { reconnects_sensor_ = sensor; }
+  void set_bytes_in_sensor(sensor::Sensor *sensor) { bytes_in_sensor_ = sensor; }
+  void set_bytes_out_sensor(sensor::Sensor *sensor) { bytes_out_sensor_ = sensor; }
+#endif
+  void set_max_in_flight(uint8_t max_in_flight) { max_in_flight_ = max_in_flight > 0 ? max_in_flight : 1; }
+  void set_register_gap(uint16_t register_gap) { register_gap_ = register_gap; }
+  // limit of simultaneous connections for all Modbus TCP components (0 - unlimited)
+  static void set_max_connections(uint8_t max_connections) { max_connections_ = max_connections; }
   void set_on_connect(ModbusTcpOnConnect handler) { on_connect_ = handler; }
   void set_on_disconnect(ModbusTcpOnDisconnect handler) { on_disconnect_ = handler; }
   void set_on_error(ModbusTcpOnError handler) { on_error_ = handler; }
   void set_on_register_response(ModbusTcpOnRegisterResponse handler) { on_register_response_ = handler; }
+  // responses of unit `unit_id` are returned with `handler` instead of on_register_response_
+  void set_on_unit_register_response(uint8_t unit_id, ModbusTcpOnRegisterResponse handler) {
+    unit_handlers_[unit_id] = handler;
+  }
+
+  // Reads registers range of any size. Ranges bigger than MAX_READ_REGISTERS are split to several requests
+  // and returned with one on_register_response_ call. Result is stored into `buffer` (should have
+  // 2 * registers_count bytes) when it was provided, otherwise into buffer allocated for this request.
+  // data is returned with `handler` or with on_register_response_ when handler was not set
+  bool read_registers(uint8_t response_code, uint16_t first_register, uint16_t registers_count = 1,
+                      uint8_t *buffer = nullptr, ModbusTcpOnRegisterResponse handler = nullptr) {
+    return read_unit_registers(address_, response_code, first_register, registers_count, buffer, handler);
+  }
 
-  bool read_registers(uint8_t response_code, uint16_t first_register, uint16_t registers_count = 1) {
-    if (connected_) {
-      uint16_t rx_size = 9 + 2 * registers_count; // > MAX_RX_BUFFER_SIZE;
-      if (rx_size > MAX_RX_BUFFER_SIZE) {
-        ESP_LOGW(TAG, "Too small RX buffer (current size %d, needed %d)", MAX_RX_BUFFER_SIZE, rx_size);
+  bool read_unit_registers(uint8_t unit_id, uint8_t response_code, uint16_t first_register,
+                           uint16_t registers_count = 1, uint8_t *buffer = nullptr,
+                           ModbusTcpOnRegisterResponse handler = nullptr) {
+    if (can_queue()) {
+      if (registers_count == 0 || (uint32_t) first_register + registers_count > 0x10000) {
+        ESP_LOGW(TAG, "Wrong registers range for request (first 0x%04x, count %d)", first_register, registers_count);
         return false;
       }
-      ESP_LOGV(TAG, "read_registers(%d, %04x, %04x)", response_code, first_register, registers_count);
-      this->commands_queue_.push(make_unique<ModbusTcpCommand>(0x03, response_code, first_register, registers_count));
+      ESP_LOGV(TAG, "read_registers(%d, %d, %04x, %04x)", unit_id, response_code, first_register, registers_count);
+      if (registers_count <= MAX_READ_REGISTERS && buffer == nullptr && handler == nullptr) {
+        push_command(make_unique<ModbusTcpCommand>(unit_id, 0x03, response_code, first_register, registers_count));
+        return true;
+      }
+      auto result = std::make_shared<ModbusTcpReadResult>();
+      result->response_code = response_code;
+      result->first_register = first_register;
+      result->registers_count = registers_count;
+      result->remaining = (registers_count + MAX_READ_REGISTERS - 1) / MAX_READ_REGISTERS;
+      result->on_response = handler;
+      if (buffer == nullptr) {
+        result->buffer.resize(2 * registers_count);
+        buffer = result->buffer.data();
+      }
+      result->data = buffer;
+      ESP_LOGV(TAG, "Split read of %d registers to %d requests", registers_count, result->remaining);
+      for (uint32_t offset = 0; offset < registers_count; offset += MAX_READ_REGISTERS) {
+        uint16_t count = std::min((uint32_t) MAX_READ_REGISTERS, registers_count - offset);
+        auto command = make_unique<ModbusTcpCommand>(unit_id, 0x03, response_code, first_register + offset, count);
+        command->result = result;
+        push_command(std::move(command));
+      }
     }
-    return connected_;
+    return can_queue();
   }
 
-  bool write_register(uint8_t response_code, uint16_t address_register, uint16_t value) {
-    if (connected_) {
-      ESP_LOGV(TAG, "write_register(%d, %04x, %04x)", response_code, address_register, value);
-      this->commands_queue_.push(make_unique<ModbusTcpCommand>(0x06, response_code, address_register, value));
+  // Adds registers block which will be read every `interval` ms (and on every connect). Blocks which are due
+  // at the same time and have not more than register_gap_ unused registers between them are merged to one
+  // request. Data is returned with `handler` or with on_register_response_ when handler was not set.
+  void add_register_block(uint8_t response_code, uint16_t first_register, uint16_t registers_count,
+                          uint32_t interval = 0, ModbusTcpOnRegisterResponse handler = nullptr) {
+    add_unit_register_block(address_, response_code, first_register, registers_count, interval, handler);
+  }
+
+  void add_unit_register_block(uint8_t unit_id, uint8_t response_code, uint16_t first_register,
+                               uint16_t registers_count, uint32_t interval = 0,
+                               ModbusTcpOnRegisterResponse handler = nullptr) {
+    if (registers_count == 0 || registers_count > MAX_READ_REGISTERS ||
+        (uint32_t) first_register + registers_count > 0x10000) {
+      ESP_LOGW(TAG, "Wrong registers block (first 0x%04x, count %d)", first_register, registers_count);
+      return;
     }
-    return connected_;
+    register_blocks_.push_back({unit_id, response_code, first_register, registers_count, interval, 0, handler});
+  }
+
+  // request reading of all registers blocks as soon as possible
+  void request_register_blocks() {
+    for (auto &block : register_blocks_)
+      block.next_time = 0;
+  }
+
+  // `must_deliver` commands can be queued while disconnected and are not dropped on reconnect
+  bool write_register(uint8_t response_code, uint16_t address_register, uint16_t value, bool must_deliver = false) {
+    return write_unit_register(address_, response_code, address_register, value, must_deliver);
+  }
+
+  bool write_unit_register(uint8_t unit_id, uint8_t response_code, uint16_t address_register, uint16_t value,
+                           bool must_deliver = false) {
+    if (can_queue(must_deliver)) {
+      ESP_LOGV(TAG, "write_register(%d, %d, %04x, %04x)", unit_id, response_code, address_register, value);
+      auto command = make_unique<ModbusTcpCommand>(unit_id, 0x06, response_code, address_register, value);
+      command->must_deliver = must_deliver;
+      push_command(std::move(command));
+    }
+    return can_queue(must_deliver);
+  }
+
+  // write multiple registers (function 0x10); confirmed written values are returned with response code
+  bool write_registers(uint8_t response_code, uint16_t first_register, const std::vector<uint16_t> &values,
+                       bool must_deliver = false) {
+    return write_unit_registers(address_, response_code, first_register, values, must_deliver);
+  }
+
+  bool write_unit_registers(uint8_t unit_id, uint8_t response_code, uint16_t first_register,
+                            const std::vector<uint16_t> &values, bool must_deliver = false) {
+    if (values.empty() || values.size() > MAX_WRITE_REGISTERS) {
+      ESP_LOGW(TAG, "Wrong registers count (%d) for write", values.size());
+      return false;
+    }
+    if (can_queue(must_deliver)) {
+      ESP_LOGV(TAG, "write_registers(%d, %d, %04x, %d)", unit_id, response_code, first_register, values.size());
+      auto command = make_unique<ModbusTcpCommand>(unit_id, 0x10, response_code, first_register, values.size());
+      command->must_deliver = must_deliver;
+      command->values = values;
+      push_command(std::move(command));
+    }
+    return can_queue(must_deliver);
   }
 
  protected:
   void delay(uint32_t delay_ms) { this->sleep_time_ = millis() + delay_ms; }
 
+  // with pooled connections commands are queued also while other hosts are holding connections
+  bool can_queue(bool must_deliver = false) {
+    return connected_ || (can_connect_ && (max_connections_ > 0 || must_deliver));
+  }
+
+  // every unit has own queue; units are served in round-robin order
+  void push_command(std::unique_ptr<ModbusTcpCommand> command) {
+    commands_queues_[command->unit_id].push(std::move(command));
+  }
+
+  bool has_commands() {
+    for (auto &it : commands_queues_)
+      if (!it.second.empty())
+        return true;
+    return false;
+  }
+
+  std::unique_ptr<ModbusTcpCommand> pop_command() {
+    auto it = commands_queues_.upper_bound(last_unit_id_);
+    for (size_t i = 0; i < commands_queues_.size(); i++, it++) {
+      if (it == commands_queues_.end())
+        it = commands_queues_.begin();
+      if (!it->second.empty()) {
+        auto command = std::move(it->second.front());
+        it->second.pop();
+        last_unit_id_ = it->first;
+        return command;
+      }
+    }
+    return nullptr;
+  }
+
+  // pooled connection: wait for free connection slot when limit is set; hosts get slots in order of waiting
+  bool acquire_connection(unsigned long current_time) {
+    if (max_connections_ == 0 || holding_connection_)
+      return true;
+    auto it = std::find(waiting_.begin(), waiting_.end(), this);
+    // don't take connection without work for it
+    if (!has_commands() && !has_due_register_blocks(current_time)) {
+      if (it != waiting_.end())
+        waiting_.erase(it);
+      return false;
+    }
+    if (connections_count_ < max_connections_ && (waiting_.empty() || waiting_.front() == this)) {
+      if (it != waiting_.end())
+        waiting_.erase(it);
+      connections_count_++;
+      holding_connection_ = true;
+      return true;
+    }
+    if (it == waiting_.end())
+      waiting_.push_back(this);
+    return false;
+  }
+
+  void release_connection() {
+    if (holding_connection_) {
+      connections_count_--;
+      holding_connection_ = false;
+    }
+  }
+
+  bool has_due_register_blocks(unsigned long current_time) {
+    for (auto &block : register_blocks_)
+      if (!block.outstanding && block.next_time <= current_time && (block.next_time == 0 || block.interval > 0))
+        return true;
+    return false;
+  }
+
+  // exponential backoff with "equal jitter": random delay from [d/2, d], where d = min(max, min * 2^attempt)
+  uint32_t reconnect_delay() {
+    uint32_t delay_ms = RECONNECT_MIN_DELAY << std::min<int16_t>(connect_attempt_, 16);
+    delay_ms = std::min(delay_ms, max_reconnect_delay_);
+    return delay_ms / 2 + random_uint32() % (delay_ms / 2 + 1);
+  }
+
   void connect() {
     ESP_LOGD(TAG, "Try to connect (attempt %d)", connect_attempt_);
     connecting_ = false;
     if (client_->connect(ip_address_.c_str(), port_)) {
       connecting_ = true;
     } else {
-      ESP_LOGW(TAG, "Failed to connect");
-      delay(3000);
+      uint32_t delay_ms = reconnect_delay();
+      ESP_LOGW(TAG, "Failed to connect, next attempt in %u ms", delay_ms);
+      delay(delay_ms);
       connecting_ = false;
-      connect_attempt_++;
+      if (connect_attempt_ < INT16_MAX)
+        connect_attempt_++;
+      release_connection();
+      if (released_)
+        finish_release();
     }
   }
 
+  // pooled connection was released earlier and host is not connected anymore: finish disconnection for consumers
+  void finish_release() {
+    released_ = false;
+    request_register_blocks();
+    forget_register_block_reads();
+    keep_must_deliver_commands();
+    if (on_disconnect_)
+      on_disconnect_();
+  }
+
   void on_connect(AsyncClient *client) {
     ESP_LOGD(TAG, "Connected");
     delay(delay_after_connect_);
     connect_attempt_ = 0;
     connected_ = true;
     connecting_ = false;
-    if (on_connect_)
+    connected_time_ = millis();
+    expired_tx_ids_.clear();
+    stale_responses_ = timeouts_in_row_ = 0;
+    // reconnecting of pooled connection is not visible for consumers
+    if (on_connect_ && !released_)
       on_connect_();
+    released_ = false;
   }
 
   void on_disconnect(AsyncClient *client) {
+    release_connection();
+    if (releasing_) {
+      // connection was given to other host: keep queued commands and consumers state
+      ESP_LOGD(TAG, "Disconnected (released)");
+      releasing_ = false;
+      client->close(true);
+      {
+        LockGuard lock(rx_lock_);
+        rx_frame_size_ = rx_bytes_received_ = 0;
+      }
+      connecting_ = false;
+      connected_ = false;
+      return;
+    }
     if (can_connect_ && !connected_) {
-      ESP_LOGW(TAG, "Failed to connect");
-      connect_attempt_++;
-      delay(1000);
+      uint32_t delay_ms = reconnect_delay();
+      ESP_LOGW(TAG, "Failed to connect, next attempt in %u ms", delay_ms);
+      if (connect_attempt_ < INT16_MAX)
+        connect_attempt_++;
+      delay(delay_ms);
     } else if (can_connect_) {
-      ESP_LOGW(TAG, "Disconnected");
-      delay(1000);
+      reconnects_count_++;
+      uint32_t delay_ms = reconnect_delay();
+      ESP_LOGW(TAG, "Disconnected, reconnect in %u ms", delay_ms);
+      delay(delay_ms);
     } else {
       ESP_LOGD(TAG, "Disconnected");
     }
     client->close(true);
-    commands_queue_ = {};
+    request_register_blocks();
+    forget_register_block_reads();
+    keep_must_deliver_commands();
+    in_flight_.clear();
+    {
+      LockGuard lock(rx_lock_);
+      rx_frame_size_ = rx_bytes_received_ = 0;
+      rx_frames_ = {};
+    }
     connecting_ = false;
     connected_ = false;
+    // failed reconnect of released connection is reported to consumers as well
+    released_ = false;
     if (on_disconnect_)
       on_disconnect_();
   }
 
+  // reads of registers blocks are dropped with queued commands on disconnect
+  void forget_register_block_reads() {
+    for (auto &block : register_blocks_)
+      block.outstanding = false;
+  }
+
+  // drop queued commands except `must_deliver` ones (unanswered transactions are queued again first)
+  void keep_must_deliver_commands() {
+    auto queues = std::move(commands_queues_);
+    commands_queues_.clear();
+    if (!can_connect_)
+      return;
+    for (auto &command : in_flight_) {
+      if (command->must_deliver)
+        push_command(std::move(command));
+    }
+    for (auto &it : queues) {
+      for (; !it.second.empty(); it.second.pop()) {
+        if (it.second.front()->must_deliver)
+          push_command(std::move(it.second.front()));
+      }
+    }
+    if (has_commands())
+      ESP_LOGD(TAG, "Keeping commands which must be delivered");
+  }
+
   void on_data(AsyncClient *client, void *bytes, size_t len) {
     uint8_t *buffer = (uint8_t *) bytes;
 #ifdef USE_TCP_DEBUGGER
@@ -179,123 +532,353 @@ class ModbusTcpComponent : public Component {
     log_hex(DIRECTION_RX, data, ' ');
 #endif
     ESP_LOGV(TAG, "Received %d bytes", len);
-    for (size_t i = 0; i < len && rx_bytes_received_ < rx_bytes_needed_; i++)
-      rx_buffer_[rx_bytes_received_++] = buffer[i];
-  }
-
-  bool process_command(ModbusTcpCommand *command) {
-    ESP_LOGV(TAG, "Phase %d: command 0x%02X", command->phase, command->function);
-    switch (command->phase) {
-      case 0: {
-        // prepare data to send
-        command->tx_id = ++last_tx_id_;
-        uint16_t request_length = 6;
-        uint8_t buf_len = 0;
-        tx_buffer_[buf_len++] = (command->tx_id >> 8) & 0xFF;  // Transaction Identifier
-        tx_buffer_[buf_len++] = command->tx_id & 0xFF;
-        tx_buffer_[buf_len++] = (PROTOCOL_ID >> 8) & 0xFF;  // Protocol Identifier always 0x0000
-        tx_buffer_[buf_len++] = PROTOCOL_ID & 0xFF;
-        tx_buffer_[buf_len++] = (request_length >> 8) & 0xFF;  // Message Length
-        tx_buffer_[buf_len++] = request_length & 0xFF;
-        tx_buffer_[buf_len++] = address_;           // Unit Identifier
-        tx_buffer_[buf_len++] = command->function;  // Function Code
-        // TODO refactor vor vector
-        tx_buffer_[buf_len++] = (command->data1 >> 8) & 0xFF;
-        tx_buffer_[buf_len++] = command->data1 & 0xFF;
-        tx_buffer_[buf_len++] = (command->data2 >> 8) & 0xFF;
-        tx_buffer_[buf_len++] = command->data2 & 0xFF;
+    if (!frame_data(buffer, len)) {
+      // can't find next frame start in TCP stream, so drop connection
+      client->close(true);
+    }
+  }
 
-#ifdef USE_TCP_DEBUGGER
-        std::vector<uint8_t> data;
-        data.assign((uint8_t *) tx_buffer_, (uint8_t *) tx_buffer_ + buf_len);
-        log_hex(DIRECTION_TX, data, ' ');
-#endif
-        // send command
-        if (!client_->write((char *) tx_buffer_, buf_len)) {
-          ESP_LOGW(TAG, "Failed to send command 0x%02X", command->function);
-          return true;
-        }
-        // calculate bytes to receive
-        command->length = 2 + (command->function == 0x03 ? 1 + 2 * command->data2 : 4);
-        rx_bytes_received_ = 0;
-        rx_bytes_needed_ = 6 + command->length;
-        receive_wait_time_ = millis() + timeout_;  // timeout N milliseconds
-        delay(100);
-      } break;
-
-      case 1: {
-        // wait complete packet?
-        if (rx_bytes_received_ < rx_bytes_needed_) {
-          if (receive_wait_time_ < millis()) {
-            ESP_LOGW(TAG, "Timed out for command 0x%02X!", command->function);
-            client_->stop();
-            return true;
-          }
-          delay(5);  // wait some time for next bytes
+  // MBAP framing: one TCP segment may contain part of ADU or several ADUs
+  bool frame_data(uint8_t *buffer, size_t len) {
+    LockGuard lock(rx_lock_);
+    bytes_in_ += len;
+    while (len > 0) {
+      uint16_t needed = (rx_frame_size_ == 0 ? MBAP_HEADER_SIZE : rx_frame_size_) - rx_bytes_received_;
+      uint16_t chunk = std::min((size_t) needed, len);
+      memcpy(rx_buffer_ + rx_bytes_received_, buffer, chunk);
+      rx_bytes_received_ += chunk;
+      buffer += chunk;
+      len -= chunk;
+      if (rx_frame_size_ == 0 && rx_bytes_received_ == MBAP_HEADER_SIZE) {
+        // header completed: check protocol and take frame size from length field
+        uint16_t protocol = (uint16_t) rx_buffer_[2] << 8 | rx_buffer_[3];
+        uint16_t length = (uint16_t) rx_buffer_[4] << 8 | rx_buffer_[5];
+        if (protocol != PROTOCOL_ID || length < 3 || MBAP_HEADER_SIZE + length > MAX_ADU_SIZE) {
+          ESP_LOGW(TAG, "Wrong MBAP header (protocol 0x%04x, length %d). Closing connection", protocol, length);
+          rx_bytes_received_ = 0;
           return false;
         }
-      } break;
-
-      case 2: {
-        // validation
-        uint8_t buf_len = 0;
-        uint16_t tx_id = (uint16_t) rx_buffer_[buf_len++] << 8 | rx_buffer_[buf_len++];
-        if (tx_id != command->tx_id) {
-          ESP_LOGW(TAG, "Wrong transaction id for command 0x%02X (0x%04x instead of 0x%04x)", command->function, tx_id,
-                   command->tx_id);
-          return true;
-        }
-        uint16_t protocol = (uint16_t) rx_buffer_[buf_len++] << 8 | rx_buffer_[buf_len++];
-        if (protocol != PROTOCOL_ID) {
-          ESP_LOGW(TAG, "Wrong protocol 0x%04x for command 0x%02X", protocol, command->function);
-          return true;
-        }
-        uint16_t length = (uint16_t) rx_buffer_[buf_len++] << 8 | rx_buffer_[buf_len++];
-        if (length != command->length) {
-          ESP_LOGW(TAG, "Wrong length for command 0x%02X (%d instead of %d)", command->function, length,
-                   command->length);
-          return true;
-        }
-        uint8_t address = rx_buffer_[buf_len++];
-        if (address != address_) {
-          ESP_LOGW(TAG, "Wrong address for command 0x%02X (0x%02x instead of 0x%02x)", command->function, address,
-                   address_);
-          return true;
-        }
-        uint8_t function = rx_buffer_[buf_len++];
-        if ((function & 0x80) > 0) {
-          ESP_LOGW(TAG, "Got error 0x%02X for command 0x%02X", rx_buffer_[buf_len], command->function);
-          return true;
-        } else if (function != command->function) {
-          ESP_LOGW(TAG, "Wrong function code 0x%02X for command 0x%02X", function, command->function);
-          return true;
-        }
-        if (command->function == 0x03) {
-          uint8_t data_size = rx_buffer_[buf_len++];
-          if (data_size != command->length - 3) {
-            ESP_LOGW(TAG, "Wrong response data size for command 0x%02X (%d instead of %d)", command->function,
-                     data_size, command->length - 3);
-            return true;
-          }
+        rx_frame_size_ = MBAP_HEADER_SIZE + length;
+      }
+      if (rx_frame_size_ > 0 && rx_bytes_received_ == rx_frame_size_) {
+        rx_frames_.emplace(rx_buffer_, rx_buffer_ + rx_frame_size_);
+        rx_frame_size_ = rx_bytes_received_ = 0;
+      }
+    }
+    return true;
+  }
+
+  void schedule_register_blocks(unsigned long current_time) {
+    std::vector<uint16_t> due;
+    for (uint16_t i = 0; i < register_blocks_.size(); i++) {
+      auto &block = register_blocks_[i];
+      // previous read is not answered yet: don't pile up reads of slow host, block is read after it
+      if (block.outstanding || block.next_time > current_time || (block.next_time != 0 && block.interval == 0))
+        continue;
+      block.next_time = block.interval > 0 ? current_time + block.interval : 1;
+      due.push_back(i);
+    }
+    if (due.empty())
+      return;
+    std::sort(due.begin(), due.end(), [this](uint16_t a, uint16_t b) {
+      auto &block_a = register_blocks_[a], &block_b = register_blocks_[b];
+      return block_a.unit_id != block_b.unit_id ? block_a.unit_id < block_b.unit_id
+                                                : block_a.first_register < block_b.first_register;
+    });
+    // merge near blocks to groups, one request per group
+    size_t group_start = 0;
+    uint32_t first = register_blocks_[due[0]].first_register;
+    uint32_t last = first + register_blocks_[due[0]].registers_count;
+    for (size_t i = 1; i <= due.size(); i++) {
+      if (i < due.size()) {
+        auto &block = register_blocks_[due[i]];
+        uint32_t block_last = (uint32_t) block.first_register + block.registers_count;
+        if (block.unit_id == register_blocks_[due[group_start]].unit_id && block.first_register <= last + register_gap_ &&
+            std::max(last, block_last) - first <= MAX_READ_REGISTERS) {
+          last = std::max(last, block_last);
+          continue;
         }
-      } break;
-
-      case 3: {
-        if (on_register_response_) {
-          uint16_t register_count = (command->function == 0x03 ? command->data2 : 1);
-          ESP_LOGV(TAG, "Returning %d registers response for command 0x%02X, code 0x%02X", register_count,
-                   command->function, command->response_code);
-          on_register_response_(command->response_code, &rx_buffer_[rx_bytes_needed_ - 2 * register_count],
-                                register_count);
+      }
+      read_register_blocks(std::vector<uint16_t>(due.begin() + group_start, due.begin() + i), first, last - first);
+      if (i < due.size()) {
+        group_start = i;
+        first = register_blocks_[due[i]].first_register;
+        last = first + register_blocks_[due[i]].registers_count;
+      }
+    }
+  }
+
+  void read_register_blocks(std::vector<uint16_t> blocks, uint16_t first_register, uint16_t registers_count) {
+    uint8_t unit_id = register_blocks_[blocks[0]].unit_id;
+    ESP_LOGV(TAG, "Reading %d registers blocks of unit %d with one request (0x%04x, %d registers)", blocks.size(),
+             unit_id, first_register, registers_count);
+    auto result = std::make_shared<ModbusTcpReadResult>();
+    result->response_code = register_blocks_[blocks[0]].response_code;
+    result->first_register = first_register;
+    result->registers_count = registers_count;
+    result->remaining = 1;
+    result->buffer.resize(2 * registers_count);
+    result->data = result->buffer.data();
+    result->blocks = blocks;
+    for (uint16_t idx : blocks)
+      register_blocks_[idx].outstanding = true;
+    // return every block's slice of data to its handler
+    result->on_response = [this, blocks, first_register](uint8_t code, uint8_t *data, uint16_t register_count) {
+      for (uint16_t idx : blocks) {
+        auto &block = register_blocks_[idx];
+        uint8_t *block_data = data + 2 * (block.first_register - first_register);
+        if (block.on_response)
+          block.on_response(block.response_code, block_data, block.registers_count);
+        else
+          return_registers(block.unit_id, block.response_code, block_data, block.registers_count);
+      }
+    };
+    auto command =
+        make_unique<ModbusTcpCommand>(unit_id, 0x03, result->response_code, first_register, registers_count);
+    command->result = result;
+    push_command(std::move(command));
+  }
+
+  bool send_command(ModbusTcpCommand *command) {
+    // prepare data to send
+    command->tx_id = ++last_tx_id_;
+    uint16_t request_length = 6 + (command->function == 0x10 ? 1 + 2 * command->values.size() : 0);
+    uint8_t buf_len = 0;
+    tx_buffer_[buf_len++] = (command->tx_id >> 8) & 0xFF;  // Transaction Identifier
+    tx_buffer_[buf_len++] = command->tx_id & 0xFF;
+    tx_buffer_[buf_len++] = (PROTOCOL_ID >> 8) & 0xFF;  // Protocol Identifier always 0x0000
+    tx_buffer_[buf_len++] = PROTOCOL_ID & 0xFF;
+    tx_buffer_[buf_len++] = (request_length >> 8) & 0xFF;  // Message Length
+    tx_buffer_[buf_len++] = request_length & 0xFF;
+    tx_buffer_[buf_len++] = command->unit_id;   // Unit Identifier
+    tx_buffer_[buf_len++] = command->function;  // Function Code
+    // TODO refactor vor vector
+    tx_buffer_[buf_len++] = (command->data1 >> 8) & 0xFF;
+    tx_buffer_[buf_len++] = command->data1 & 0xFF;
+    tx_buffer_[buf_len++] = (command->data2 >> 8) & 0xFF;
+    tx_buffer_[buf_len++] = command->data2 & 0xFF;
+    if (command->function == 0x10) {
+      tx_buffer_[buf_len++] = 2 * command->values.size();  // Byte Count
+      for (uint16_t value : command->values) {
+        tx_buffer_[buf_len++] = (value >> 8) & 0xFF;
+        tx_buffer_[buf_len++] = value & 0xFF;
+      }
+    }
+
+#ifdef USE_TCP_DEBUGGER
+    std::vector<uint8_t> data;
+    data.assign((uint8_t *) tx_buffer_, (uint8_t *) tx_buffer_ + buf_len);
+    log_hex(DIRECTION_TX, data, ' ');
+#endif
+    // send command
+    if (!client_->write((char *) tx_buffer_, buf_len)) {
+      ESP_LOGW(TAG, "Failed to send command 0x%02X", command->function);
+      return false;
+    }
+    bytes_out_ += buf_len;
+    command->send_time = millis();
+    // expected response length (unit identifier + PDU)
+    command->length = 2 + (command->function == 0x03 ? 1 + 2 * command->data2 : 4);
+    command->timeout_time = command->send_time + timeout_;  // timeout N milliseconds
+    ESP_LOGV(TAG, "Sent command 0x%02X (transaction 0x%04x, %d in flight)", command->function, command->tx_id,
+             in_flight_.size() + 1);
+    return true;
+  }
+
+  void process_responses() {
+    while (true) {
+      std::vector<uint8_t> frame;
+      {
+        LockGuard lock(rx_lock_);
+        if (rx_frames_.empty())
+          return;
+        frame = std::move(rx_frames_.front());
+        rx_frames_.pop();
+      }
+      process_response(frame.data(), frame.size());
+    }
+  }
+
+  void process_response(uint8_t *frame, uint16_t frame_size) {
+    // find transaction in flight
+    uint8_t buf_len = 0;
+    uint16_t tx_id = (uint16_t) frame[buf_len++] << 8 | frame[buf_len++];
+    auto it = std::find_if(in_flight_.begin(), in_flight_.end(),
+                           [tx_id](const std::unique_ptr<ModbusTcpCommand> &c) { return c->tx_id == tx_id; });
+    if (it == in_flight_.end()) {
+      auto expired = std::find(expired_tx_ids_.begin(), expired_tx_ids_.end(), tx_id);
+      if (expired != expired_tx_ids_.end()) {
+        ESP_LOGD(TAG, "Got late response for expired transaction 0x%04x", tx_id);
+        expired_tx_ids_.erase(expired);
+      } else {
+        ESP_LOGW(TAG, "Got response with unknown transaction id 0x%04x", tx_id);
+      }
+      // responses keep coming not for transactions in flight: stream is out of sync with requests
+      if (++stale_responses_ >= MAX_STALE_RESPONSES) {
+        ESP_LOGW(TAG, "Got %d stale responses in row. Closing connection", stale_responses_);
+        stale_responses_ = 0;
+        client_->stop();
+      }
+      return;
+    }
+    stale_responses_ = timeouts_in_row_ = 0;
+    std::unique_ptr<ModbusTcpCommand> command = std::move(*it);
+    in_flight_.erase(it);
+    add_rtt(millis() - command->send_time);
+
+    bool valid = validate_response(command.get(), frame);
+    if (!valid && on_error_)
+      on_error_(command->response_code, (frame[7] & 0x80) > 0 ? frame[8] : 0);
+    uint16_t register_count = (command->function == 0x03 ? command->data2 : 1);
+    uint8_t *data = valid ? &frame[frame_size - 2 * register_count] : nullptr;
+    auto &result = command->result;
+    if (result == nullptr && command->function == 0x10) {
+      // response has only address and quantity, so return written values confirmed by it
+      if (valid) {
+        std::vector<uint8_t> values;
+        for (uint16_t value : command->values) {
+          values.push_back((value >> 8) & 0xFF);
+          values.push_back(value & 0xFF);
         }
-      } break;
+        return_registers(command->unit_id, command->response_code, values.data(), command->values.size());
+      }
+    } else if (result == nullptr) {
+      if (valid)
+        return_registers(command->unit_id, command->response_code, data, register_count);
+    } else {
+      // part of registers range: collect data into result buffer and return it after the last part
+      if (valid)
+        memcpy(result->data + 2 * (command->data1 - result->first_register), data, 2 * register_count);
+      else
+        result->failed = true;
+      complete_result_part(command->unit_id, result.get());
+    }
+    ESP_LOGV(TAG, "Command 0x%02X function completed", command->function);
+  }
 
-      default:
-        ESP_LOGV(TAG, "Command 0x%02X function completed", command->function);
-        return true;
+  // registers range is returned after its last part
+  void complete_result_part(uint8_t unit_id, ModbusTcpReadResult *result) {
+    if (--result->remaining > 0)
+      return;
+    for (uint16_t idx : result->blocks)
+      register_blocks_[idx].outstanding = false;
+    if (result->failed)
+      ESP_LOGW(TAG, "Failed to read %d registers from 0x%04x", result->registers_count, result->first_register);
+    else if (result->on_response)
+      result->on_response(result->response_code, result->data, result->registers_count);
+    else
+      return_registers(unit_id, result->response_code, result->data, result->registers_count);
+  }
+
+  // timed out transaction is retired: its late response is ignored and consumers get error for it
+  void expire_command(ModbusTcpCommand *command) {
+    ESP_LOGW(TAG, "Timed out for command 0x%02X (transaction 0x%04x)!", command->function, command->tx_id);
+    timeouts_count_++;
+    timeouts_in_row_++;
+    expired_tx_ids_.push_back(command->tx_id);
+    if (expired_tx_ids_.size() > MAX_EXPIRED_TX_IDS)
+      expired_tx_ids_.pop_front();
+    if (on_error_)
+      on_error_(command->response_code, 0);
+    if (command->result != nullptr) {
+      command->result->failed = true;
+      complete_result_part(command->unit_id, command->result.get());
+    }
+  }
+
+  void return_registers(uint8_t unit_id, uint8_t response_code, uint8_t *data, uint16_t register_count) {
+    ESP_LOGV(TAG, "Returning %d registers response of unit %d for code 0x%02X", register_count, unit_id,
+             response_code);
+    auto it = unit_handlers_.find(unit_id);
+    if (it != unit_handlers_.end())
+      it->second(response_code, data, register_count);
+    else if (on_register_response_)
+      on_register_response_(response_code, data, register_count);
+  }
+
+  void add_rtt(uint32_t rtt) {
+    rtt_sum_ += rtt;
+    rtt_count_++;
+    for (uint8_t i = 0; i < RTT_BUCKETS_COUNT; i++) {
+      if (rtt <= RTT_BUCKETS[i]) {
+        rtt_histogram_[i]++;
+        break;
+      }
     }
-    command->phase++;
-    return false;
+  }
+
+  void publish_telemetry() {
+    uint32_t bytes_in;
+    {
+      LockGuard lock(rx_lock_);
+      bytes_in = bytes_in_;
+    }
+    ESP_LOGD(TAG, "RTT histogram (<=50/100/200/500/1000/more ms): %u/%u/%u/%u/%u/%u", rtt_histogram_[0],
+             rtt_histogram_[1], rtt_histogram_[2], rtt_histogram_[3], rtt_histogram_[4], rtt_histogram_[5]);
+    ESP_LOGD(TAG, "Timeouts: %u, reconnects: %u, bytes in: %u, bytes out: %u", timeouts_count_, reconnects_count_,
+             bytes_in, bytes_out_);
+#ifdef USE_SENSOR
+    // RTT sensor is average for telemetry interval
+    if (rtt_sensor_ != nullptr && rtt_count_ > 0)
+      rtt_sensor_->publish_state((float) rtt_sum_ / rtt_count_);
+    if (timeouts_sensor_ != nullptr)
+      timeouts_sensor_->publish_state(timeouts_count_);
+    if (reconnects_sensor_ != nullptr)
+      reconnects_sensor_->publish_state(reconnects_count_);
+    if (bytes_in_sensor_ != nullptr)
+      bytes_in_sensor_->publish_state(bytes_in);
+    if (bytes_out_sensor_ != nullptr)
+      bytes_out_sensor_->publish_state(bytes_out_);
+#endif
+    rtt_sum_ = rtt_count_ = 0;
+  }
+
+  bool validate_response(ModbusTcpCommand *command, uint8_t *frame) {
+    uint8_t buf_len = 2;
+    uint16_t protocol = (uint16_t) frame[buf_len++] << 8 | frame[buf_len++];
+    if (protocol != PROTOCOL_ID) {
+      ESP_LOGW(TAG, "Wrong protocol 0x%04x for command 0x%02X", protocol, command->function);
+      return false;
+    }
+    uint16_t length = (uint16_t) frame[buf_len++] << 8 | frame[buf_len++];
+    uint8_t address = frame[buf_len++];
+    if (address != command->unit_id) {
+      ESP_LOGW(TAG, "Wrong address for command 0x%02X (0x%02x instead of 0x%02x)", command->function, address,
+               command->unit_id);
+      return false;
+    }
+    uint8_t function = frame[buf_len++];
+    if ((function & 0x80) > 0) {
+      ESP_LOGW(TAG, "Got error 0x%02X for command 0x%02X", frame[buf_len], command->function);
+      return false;
+    } else if (function != command->function) {
+      ESP_LOGW(TAG, "Wrong function code 0x%02X for command 0x%02X", function, command->function);
+      return false;
+    }
+    if (length != command->length) {
+      ESP_LOGW(TAG, "Wrong length for command 0x%02X (%d instead of %d)", command->function, length,
+               command->length);
+      return false;
+    }
+    if (command->function == 0x03) {
+      uint8_t data_size = frame[buf_len++];
+      if (data_size != command->length - 3) {
+        ESP_LOGW(TAG, "Wrong response data size for command 0x%02X (%d instead of %d)", command->function, data_size,
+                 command->length - 3);
+        return false;
+      }
+    } else {
+      // write responses echo register address and written value (0x06) or registers quantity (0x10)
+      uint16_t echo1 = (uint16_t) frame[buf_len++] << 8 | frame[buf_len++];
+      uint16_t echo2 = (uint16_t) frame[buf_len++] << 8 | frame[buf_len++];
+      if (echo1 != command->data1 || echo2 != command->data2) {
+        ESP_LOGW(TAG, "Wrong echo for command 0x%02X (0x%04x 0x%04x instead of 0x%04x 0x%04x)", command->function,
+                 echo1, echo2, command->data1, command->data2);
+        return false;
+      }
+    }
+
+    return true;
   }
 
   // copy from uart::UARTDebug
@@ -328,13 +911,37 @@ class ModbusTcpComponent : public Component {
   ModbusTcpOnDisconnect on_disconnect_{0};
   ModbusTcpOnError on_error_{0};
   ModbusTcpOnRegisterResponse on_register_response_{0};
-  std::queue<std::unique_ptr<ModbusTcpCommand>> commands_queue_;
+  std::map<uint8_t, std::queue<std::unique_ptr<ModbusTcpCommand>>> commands_queues_;
+  std::map<uint8_t, ModbusTcpOnRegisterResponse> unit_handlers_;
+  uint8_t last_unit_id_{0};
+  std::vector<std::unique_ptr<ModbusTcpCommand>> in_flight_;
+  std::vector<ModbusTcpRegisterBlock> register_blocks_;
+  uint16_t register_gap_{0};
   bool connecting_{false}, connected_{false}, can_connect_{false};
-  unsigned long sleep_time_{0}, receive_wait_time_{0};
+  // released_: consumers are not notified about disconnection of released pooled connection,
+  // releasing_: disconnection of connection released by this component is not handled yet
+  bool holding_connection_{false}, released_{false}, releasing_{false};
+  unsigned long sleep_time_{0}, connected_time_{0};
   int16_t connect_attempt_{0};
   uint16_t last_tx_id_{0};
-  uint8_t tx_buffer_[MAX_TX_BUFFER_SIZE], rx_buffer_[MAX_RX_BUFFER_SIZE];
-  uint16_t rx_bytes_needed_{0}, rx_bytes_received_{0};
+  std::deque<uint16_t> expired_tx_ids_;
+  uint8_t stale_responses_{0}, timeouts_in_row_{0};
+  uint8_t max_in_flight_{1};
+  uint8_t tx_buffer_[MAX_TX_BUFFER_SIZE], rx_buffer_[MAX_ADU_SIZE];
+  uint16_t rx_frame_size_{0}, rx_bytes_received_{0};
+  std::queue<std::vector<uint8_t>> rx_frames_;
+  Mutex rx_lock_;
+  // connection health telemetry (bytes_in_ is guarded by rx_lock_)
+  uint32_t max_reconnect_delay_{60000}, telemetry_interval_{0};
+  uint32_t timeouts_count_{0}, reconnects_count_{0}, bytes_in_{0}, bytes_out_{0};
+  uint32_t rtt_sum_{0}, rtt_count_{0}, rtt_histogram_[RTT_BUCKETS_COUNT]{};
+#ifdef USE_SENSOR
+  sensor::Sensor *rtt_sensor_{nullptr}, *timeouts_sensor_{nullptr}, *reconnects_sensor_{nullptr};
+  sensor::Sensor *bytes_in_sensor_{nullptr}, *bytes_out_sensor_{nullptr};
+#endif
+  // pool of connections shared by all components
+  inline static uint8_t max_connections_{0}, connections_count_{0};
+  inline static std::deque<ModbusTcpComponent *> waiting_;
 };
 
 }  // namespace modbus_tcp
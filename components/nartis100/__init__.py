@@ -3,6 +3,7 @@ import esphome.config_validation as cv
 from esphome import automation, pins
 from esphome.components import binary_sensor, sensor, text_sensor, uart
 from esphome.const import (
+    CONF_ADDRESS,
     CONF_ID,
     CONF_UART_ID,
     CONF_PASSWORD,
@@ -10,6 +11,7 @@ from esphome.const import (
     CONF_CURRENT,
     CONF_POWER,
     CONF_STARTUP_DELAY,
+    CONF_TRIGGER_ID,
     CONF_VOLTAGE,
     DEVICE_CLASS_CURRENT,
     DEVICE_CLASS_ENERGY,
@@ -28,7 +30,7 @@ from esphome.const import (
 from esphome.cpp_helpers import gpio_pin_expression
 
 DEPENDENCIES = ["uart"]
-AUTO_LOAD = ["binary_sensor", "sensor", "text_sensor"]
+AUTO_LOAD = ["binary_sensor", "meter_bus", "sensor", "text_sensor"]
 MULTI_CONF = True
 
 MAX_TARIFF_COUNT = 4
@@ -37,18 +39,81 @@ CONF_ENERGY = list(map(lambda x: "energy" + str(1 + x), range(0, MAX_TARIFF_COUN
 CONF_SERIAL_NUMBER = "serial_number"
 CONF_RELEASE_DATE = "release_date"
 CONF_ERROR = "error"
+CONF_KEEP_SESSION = "keep_session"
+CONF_SESSION_TIMEOUT = "session_timeout"
+CONF_MAX_RESPONSE_SIZE = "max_response_size"
+CONF_MAX_INFO_FIELD = "max_info_field"
+CONF_WINDOW = "window"
+CONF_OBIS_SENSORS = "obis_sensors"
+CONF_OBIS = "obis"
+CONF_CLASS_ID = "class_id"
+CONF_ATTRIBUTE_INDEX = "attribute"
+CONF_MULTIPLIER = "multiplier"
+CONF_PROFILES = "profiles"
+CONF_MAX_SPAN = "max_span"
+CONF_BACKFILL = "backfill"
+CONF_MAX_REQUESTS = "max_requests"
+CONF_ON_ROW = "on_row"
 
 nartis100_ns = cg.esphome_ns.namespace("nartis100")
 Nartis100 = nartis100_ns.class_("Nartis100", cg.PollingComponent, uart.UARTDevice)
+CommandGetProfile = nartis100_ns.class_("CommandGetProfile")
+# Triggers
+ProfileRowTrigger = nartis100_ns.class_(
+    "ProfileRowTrigger", automation.Trigger.template(cg.uint32, cg.std_vector.template(cg.float_))
+)
 # Actions
 Nartis100ForceUpdateAction = nartis100_ns.class_("Nartis100ForceUpdateAction", automation.Action)
 
+
+def obis_code(value):
+    """OBIS code as 6 groups: 1.0.32.7.0.255 or 1-0:32.7.0*255"""
+    value = cv.string_strict(value)
+    groups = value.replace("-", ".").replace(":", ".").replace("*", ".").split(".")
+    if len(groups) != 6:
+        raise cv.Invalid(f"OBIS code must have 6 groups (like 1.0.32.7.0.255), got '{value}'")
+    try:
+        groups = [int(group) for group in groups]
+    except ValueError as err:
+        raise cv.Invalid(f"OBIS code groups must be numbers, got '{value}'") from err
+    if any(group < 0 or group > 255 for group in groups):
+        raise cv.Invalid(f"OBIS code groups must be in range 0..255, got '{value}'")
+    return groups
+
+
+OBIS_SENSOR_SCHEMA = sensor.sensor_schema(
+    accuracy_decimals=2,
+    state_class=STATE_CLASS_MEASUREMENT,
+).extend({
+    cv.Required(CONF_OBIS): obis_code,
+    cv.Optional(CONF_CLASS_ID, default=3): cv.uint16_t,
+    cv.Optional(CONF_ATTRIBUTE_INDEX, default=2): cv.uint8_t,
+    cv.Optional(CONF_MULTIPLIER, default=1.0): cv.float_,
+})
+
+PROFILE_SCHEMA = cv.Schema({
+    cv.GenerateID(): cv.declare_id(CommandGetProfile),
+    cv.Required(CONF_OBIS): obis_code,
+    cv.Optional(CONF_MAX_SPAN, default="6h"): cv.positive_time_period_seconds,
+    cv.Optional(CONF_BACKFILL, default="1d"): cv.positive_time_period_seconds,
+    cv.Optional(CONF_MAX_REQUESTS, default=4): cv.int_range(min=1, max=100),
+    cv.Optional(CONF_ON_ROW): automation.validate_automation({
+        cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(ProfileRowTrigger),
+    }),
+})
+
 SCHEMA_ATTRS = {
     cv.GenerateID(): cv.declare_id(Nartis100),
 #    cv.Optional(CONF_PASSWORD, default="111"): cv.string,
     cv.Required(CONF_PASSWORD): cv.All(cv.string, cv.Length(min=3,max=8)),
     cv.Optional(CONF_DIR_PIN): pins.gpio_output_pin_schema,
+    cv.Optional(CONF_ADDRESS, default=0x10): cv.int_range(min=0x10, max=0x7D),
     cv.Optional(CONF_STARTUP_DELAY, default="10s"): cv.positive_time_period_milliseconds,
+    cv.Optional(CONF_KEEP_SESSION, default=False): cv.boolean,
+    cv.Optional(CONF_SESSION_TIMEOUT, default="120s"): cv.positive_time_period_milliseconds,
+    cv.Optional(CONF_MAX_RESPONSE_SIZE, default=512): cv.int_range(min=128, max=16384),
+    cv.Optional(CONF_MAX_INFO_FIELD, default=128): cv.int_range(min=128, max=2030),
+    cv.Optional(CONF_WINDOW, default=1): cv.int_range(min=1, max=7),
     cv.Optional(CONF_CURRENT): sensor.sensor_schema(
         unit_of_measurement=UNIT_AMPERE,
         accuracy_decimals=2,
@@ -73,6 +138,8 @@ SCHEMA_ATTRS = {
     ),
     cv.Optional(CONF_SERIAL_NUMBER): text_sensor.text_sensor_schema(),
     cv.Optional(CONF_RELEASE_DATE): text_sensor.text_sensor_schema(),
+    cv.Optional(CONF_OBIS_SENSORS): cv.ensure_list(OBIS_SENSOR_SCHEMA),
+    cv.Optional(CONF_PROFILES): cv.ensure_list(PROFILE_SCHEMA),
 }
 
 for conf_id in CONF_ENERGY:
@@ -84,7 +151,20 @@ for conf_id in CONF_ENERGY:
     )
 
 
-CONFIG_SCHEMA = cv.Schema(SCHEMA_ATTRS).extend(cv.polling_component_schema("60s")).extend(uart.UART_DEVICE_SCHEMA)
+def validate_response_size(config):
+    """every received frame is reassembled in response buffer, so frame of negotiated size must fit into it"""
+    if config[CONF_MAX_RESPONSE_SIZE] < config[CONF_MAX_INFO_FIELD]:
+        raise cv.Invalid(
+            f"{CONF_MAX_RESPONSE_SIZE} ({config[CONF_MAX_RESPONSE_SIZE]}) must not be less than "
+            f"{CONF_MAX_INFO_FIELD} ({config[CONF_MAX_INFO_FIELD]})"
+        )
+    return config
+
+
+CONFIG_SCHEMA = cv.All(
+    cv.Schema(SCHEMA_ATTRS).extend(cv.polling_component_schema("60s")).extend(uart.UART_DEVICE_SCHEMA),
+    validate_response_size,
+)
 
 FORCE_UPDATE_ACTION_SCHEMA = cv.Schema({ cv.GenerateID(CONF_ID): cv.use_id(Nartis100) })
 
@@ -92,7 +172,14 @@ FORCE_UPDATE_ACTION_SCHEMA = cv.Schema({ cv.GenerateID(CONF_ID): cv.use_id(Narti
 async def to_code(config):
     uart_component = await cg.get_variable(config[CONF_UART_ID])
     var = cg.new_Pvariable(config[CONF_ID], uart_component, config[CONF_PASSWORD])
+    cg.add(var.set_address(config[CONF_ADDRESS]))
     cg.add(var.set_startup_delay(config[CONF_STARTUP_DELAY]))
+    cg.add(var.set_keep_session(config[CONF_KEEP_SESSION]))
+    cg.add(var.set_session_timeout(config[CONF_SESSION_TIMEOUT]))
+    cg.add(var.set_max_response_size(config[CONF_MAX_RESPONSE_SIZE]))
+    cg.add(var.set_max_info_field(config[CONF_MAX_INFO_FIELD]))
+    cg.add(var.set_window(config[CONF_WINDOW]))
+    cg.add(var.set_pref_key(str(config[CONF_ID].id)))
     await cg.register_component(var, config)
 
     if dir_pin_config := config.get(CONF_DIR_PIN):
@@ -125,6 +212,22 @@ async def to_code(config):
         release_date = await text_sensor.new_text_sensor(release_date_config)
         cg.add(var.set_release_date_sensor(release_date))
 
+    for obis_config in config.get(CONF_OBIS_SENSORS, []):
+        sens = await sensor.new_sensor(obis_config)
+        cg.add(var.add_obis_sensor(sens, obis_config[CONF_CLASS_ID], obis_config[CONF_OBIS],
+                                   obis_config[CONF_ATTRIBUTE_INDEX], obis_config[CONF_MULTIPLIER]))
+
+    for profile_config in config.get(CONF_PROFILES, []):
+        profile = cg.Pvariable(profile_config[CONF_ID], var.add_profile(profile_config[CONF_OBIS]))
+        cg.add(profile.set_max_span(profile_config[CONF_MAX_SPAN]))
+        cg.add(profile.set_backfill(profile_config[CONF_BACKFILL]))
+        cg.add(profile.set_max_requests(profile_config[CONF_MAX_REQUESTS]))
+        for conf in profile_config.get(CONF_ON_ROW, []):
+            trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], profile)
+            await automation.build_automation(
+                trigger, [(cg.uint32, "timestamp"), (cg.std_vector.template(cg.float_), "values")], conf
+            )
+
 @automation.register_action("nartis100.force_update", Nartis100ForceUpdateAction, FORCE_UPDATE_ACTION_SCHEMA)
 async def update_action_to_code(config, action_id, template_arg, args):
     parent = await cg.get_variable(config[CONF_ID])
@@ -5,9 +5,8 @@ namespace nartis100 {
 
 static const char *const TAG = "nartis100";
 
-#define CHUNK_SIZE 34
-
 #define PHASE_LENGTH 10
+#define MAX_PHASES_PER_LOOP 8
 #define skip_next_phases(er) { this->phase_ += (PHASE_LENGTH - phase); this->error_ = er; return; }
 #define return_to_phase(ph) { this->phase_ += (ph - phase); return; }
 
@@ -16,59 +15,23 @@ static const uint8_t asce[] = {0x8a, 0x02, 0x07, 0x80};
 static const uint8_t mech_name[] = {0x8b, 0x07, 0x60, 0x85, 0x74, 0x05, 0x08, 0x02, 0x01};
 static const uint8_t user_info[] = {0xbe, 0x10, 0x04, 0x0e, 0x01, 0x00, 0x00, 0x00, 0x06, 0x5f, 0x1f, 0x04, 0x00, 0x00, 0x1e, 0x9d, 0xff, 0xff};
 
-static const uint16_t fcstab[256] = {
-     0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x6536, 0x74bf,
-     0x8c48, 0x9dc1, 0xaf5a, 0xbed3, 0xca6c, 0xdbe5, 0xe97e, 0xf8f7,
-     0x1081, 0x0108, 0x3393, 0x221a, 0x56a5, 0x472c, 0x75b7, 0x643e,
-     0x9cc9, 0x8d40, 0xbfdb, 0xae52, 0xdaed, 0xcb64, 0xf9ff, 0xe876,
-     0x2102, 0x308b, 0x0210, 0x1399, 0x6726, 0x76af, 0x4434, 0x55bd,
-     0xad4a, 0xbcc3, 0x8e58, 0x9fd1, 0xeb6e, 0xfae7, 0xc87c, 0xd9f5,
-     0x3183, 0x200a, 0x1291, 0x0318, 0x77a7, 0x662e, 0x54b5, 0x453c,
-     0xbdcb, 0xac42, 0x9ed9, 0x8f50, 0xfbef, 0xea66, 0xd8fd, 0xc974,
-     0x4204, 0x538d, 0x6116, 0x709f, 0x0420, 0x15a9, 0x2732, 0x36bb,
-     0xce4c, 0xdfc5, 0xed5e, 0xfcd7, 0x8868, 0x99e1, 0xab7a, 0xbaf3,
-     0x5285, 0x430c, 0x7197, 0x601e, 0x14a1, 0x0528, 0x37b3, 0x263a,
-     0xdecd, 0xcf44, 0xfddf, 0xec56, 0x98e9, 0x8960, 0xbbfb, 0xaa72,
-     0x6306, 0x728f, 0x4014, 0x519d, 0x2522, 0x34ab, 0x0630, 0x17b9,
-     0xef4e, 0xfec7, 0xcc5c, 0xddd5, 0xa96a, 0xb8e3, 0x8a78, 0x9bf1,
-     0x7387, 0x620e, 0x5095, 0x411c, 0x35a3, 0x242a, 0x16b1, 0x0738,
-     0xffcf, 0xee46, 0xdcdd, 0xcd54, 0xb9eb, 0xa862, 0x9af9, 0x8b70,
-     0x8408, 0x9581, 0xa71a, 0xb693, 0xc22c, 0xd3a5, 0xe13e, 0xf0b7,
-     0x0840, 0x19c9, 0x2b52, 0x3adb, 0x4e64, 0x5fed, 0x6d76, 0x7cff,
-     0x9489, 0x8500, 0xb79b, 0xa612, 0xd2ad, 0xc324, 0xf1bf, 0xe036,
-     0x18c1, 0x0948, 0x3bd3, 0x2a5a, 0x5ee5, 0x4f6c, 0x7df7, 0x6c7e,
-     0xa50a, 0xb483, 0x8618, 0x9791, 0xe32e, 0xf2a7, 0xc03c, 0xd1b5,
-     0x2942, 0x38cb, 0x0a50, 0x1bd9, 0x6f66, 0x7eef, 0x4c74, 0x5dfd,
-     0xb58b, 0xa402, 0x9699, 0x8710, 0xf3af, 0xe226, 0xd0bd, 0xc134,
-     0x39c3, 0x284a, 0x1ad1, 0x0b58, 0x7fe7, 0x6e6e, 0x5cf5, 0x4d7c,
-     0xc60c, 0xd785, 0xe51e, 0xf497, 0x8028, 0x91a1, 0xa33a, 0xb2b3,
-     0x4a44, 0x5bcd, 0x6956, 0x78df, 0x0c60, 0x1de9, 0x2f72, 0x3efb,
-     0xd68d, 0xc704, 0xf59f, 0xe416, 0x90a9, 0x8120, 0xb3bb, 0xa232,
-     0x5ac5, 0x4b4c, 0x79d7, 0x685e, 0x1ce1, 0x0d68, 0x3ff3, 0x2e7a,
-     0xe70e, 0xf687, 0xc41c, 0xd595, 0xa12a, 0xb0a3, 0x8238, 0x93b1,
-     0x6b46, 0x7acf, 0x4854, 0x59dd, 0x2d62, 0x3ceb, 0x0e70, 0x1ff9,
-     0xf78f, 0xe606, 0xd49d, 0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330,
-     0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
-};
-
-
 int Command::fill_notification_request(package_t *raw_package) {
   uint8_t *pkt_buff = (uint8_t*)raw_package;
   set_header(raw_package);
 
   // I don't know how true
-  raw_package->header.control = ((((meter.rrr << 5) + (meter.sss << 1)) | 0x10)) & 0xFE;
-  // raw_package->header.control = ((((meter.rrr << 5) + (meter.sss << 1)) | 0x10) + 2) & 0xFE;
-  meter.format.length += 3;                       /* + size command + size HCS   */
+  raw_package->header.control = ((((this->meter_->rrr << 5) + (this->meter_->sss << 1)) | 0x10)) & 0xFE;
+  // raw_package->header.control = ((((this->meter_->rrr << 5) + (this->meter_->sss << 1)) | 0x10) + 2) & 0xFE;
+  this->meter_->format.length += 3;                       /* + size command + size HCS   */
 
-  uint8_t *format = (uint8_t*)&(meter.format);
+  uint8_t *format = (uint8_t*)&(this->meter_->format);
   raw_package->header.format[0] = format[1];
   raw_package->header.format[1] = format[0];
-  uint16_t crc = checksum(pkt_buff + 1, meter.format.length - 2);
+  uint16_t crc = checksum(pkt_buff + 1, this->meter_->format.length - 2);
   raw_package->data[0] = crc & 0xff;
   raw_package->data[1] = (crc >> 8) & 0xff;
   raw_package->data[2] = FLAG;
-  return meter.format.length + 2;
+  return this->meter_->format.length + 2;
 }
 
 bool Command::publish_result() {
@@ -86,11 +49,11 @@ bool Command::publish_result() {
 
 size_t Command::set_header(package_t *raw_package) {
   raw_package->header.flag = FLAG;
-  meter.format.length = 2;   /* format 2 bytes */
-  set_address(raw_package->header.addr, 2, meter.server_lower_addr, meter.server_upper_addr);
-  set_address(raw_package->header.addr + 2, 1, 0, meter.client_addr);
-  meter.format.length += 3;
-  return meter.format.length;
+  this->meter_->format.length = 2;   /* format 2 bytes */
+  set_address(raw_package->header.addr, 2, this->meter_->server_lower_addr, this->meter_->server_upper_addr);
+  set_address(raw_package->header.addr + 2, 1, 0, this->meter_->client_addr);
+  this->meter_->format.length += 3;
+  return this->meter_->format.length;
 }
 
 uint8_t Command::set_address(uint8_t *buff, uint8_t len, uint16_t lower, uint16_t upper) {
@@ -143,63 +106,30 @@ uint8_t Command::get_address(uint8_t *buff, uint8_t len, uint16_t *lower, uint16
     return ret;
 }
 
-uint8_t Command::get_address_size(uint8_t *buff) {
-    uint8_t size = 0;
-    if (*(buff++) & 1) {
-        size++;
-    } else {
-        size++;
-        if (*(buff++) & 1) {
-            size++;
-        } else {
-            size++;
-            if (*(buff++) & 1) {
-                size++;
-            } else {
-                size++;
-                if (*(buff++) & 1) {
-                    size++;
-                } else {
-                    size = 0;
-                }
-            }
-        }
+/* address is extended by next bytes while lowest bit is 0: 1, 2 or 4 bytes, but not more than `max_len` */
+uint8_t Command::get_address_size(const uint8_t *buff, uint8_t max_len) {
+    for (uint8_t size = 1; size <= 4 && size <= max_len; size++) {
+        if (buff[size - 1] & 1)
+            return size == 3 ? 0 : size;
     }
-    if (size != 0 && size != 1 && size != 2 && size != 4) size = 0;
-    return size;
+    return 0;
 }
 
 uint16_t Command::checksum(const uint8_t *src_buffer, size_t len) {
-    uint16_t crc = 0xffff;
-    while(len--) {
-        crc = (crc >> 8) ^ fcstab[(crc ^ *src_buffer++) & 0xff];
-    }
-    crc ^= 0xffff;
-    return crc;
+    return meter_bus::Crc16X25::process(0xffff, src_buffer, len) ^ 0xffff;
 }
 
-int Command::request_data(request_t *request, package_t *raw_package) {
+/* information frame with `info_field_len` bytes already placed after HCS */
+int Command::fill_info_request(package_t *raw_package, uint8_t info_field_len) {
   uint8_t *pkt_buff = (uint8_t*)raw_package;
-  uint8_t *info_field_data = (uint8_t*) raw_package->data + 2;
-  uint8_t info_field_len = 0;
-
-  info_field_data[info_field_len++] = LSAP;
-  info_field_data[info_field_len++] = CMD_LSAP;
-  info_field_data[info_field_len++] = 0;
-  info_field_data[info_field_len++] = GET_REQUEST;
-  info_field_data[info_field_len++] = 0x01;
-  info_field_data[info_field_len++] = 0xc1;
-
-  memcpy(info_field_data + info_field_len, request, sizeof(request_t));
-  info_field_len += sizeof(request_t);
 
   uint8_t hcs_len = set_header(raw_package) + 1;
-  raw_package->header.control = ((((meter.rrr << 5) + (meter.sss << 1)) | 0x10) + (meter.format.segmentation?0:2)) & 0xFE;
-  meter.format.length += 3;                       /* + size command + size HCS   */
+  raw_package->header.control = ((((this->meter_->rrr << 5) + (this->meter_->sss << 1)) | 0x10) + (this->meter_->format.segmentation?0:2)) & 0xFE;
+  this->meter_->format.length += 3;                       /* + size command + size HCS   */
 
-  meter.format.length += info_field_len + 2;      /* + size FCS                   */
+  this->meter_->format.length += info_field_len + 2;      /* + size FCS                   */
 
-  uint8_t *format = (uint8_t*)&(meter.format);
+  uint8_t *format = (uint8_t*)&(this->meter_->format);
   raw_package->header.format[0] = format[1];
   raw_package->header.format[1] = format[0];
 
@@ -207,11 +137,11 @@ int Command::request_data(request_t *request, package_t *raw_package) {
   raw_package->data[1] = (crc >> 8) & 0xff;
   raw_package->data[0] = crc & 0xff;
 
-  crc = checksum(pkt_buff+1, meter.format.length - 2);
+  crc = checksum(pkt_buff+1, this->meter_->format.length - 2);
   raw_package->data[info_field_len + 2] = crc & 0xff;
   raw_package->data[info_field_len + 3] = (crc >> 8) & 0xff;
   raw_package->data[info_field_len + 4] = FLAG;
-  return meter.format.length + 2;
+  return this->meter_->format.length + 2;
 }
 
 uint32_t Command::reverse32(uint32_t in) {
@@ -225,6 +155,131 @@ uint32_t Command::reverse32(uint32_t in) {
     return out;
 }
 
+/* A-XDR length: one byte below 0x80 or 0x8N followed by N bytes of length */
+const uint8_t *DataDecoder::length(const uint8_t *ptr, const uint8_t *end, size_t *length) {
+  if (ptr >= end)
+    return nullptr;
+  uint8_t size = *ptr++;
+  if ((size & 0x80) == 0) {
+    *length = size;
+    return ptr;
+  }
+  size &= 0x7f;
+  if (size > sizeof(uint32_t) || end - ptr < size)
+    return nullptr;
+  for (*length = 0; size > 0; size--)
+    *length = (*length << 8) | *ptr++;
+  return ptr;
+}
+
+/* size of primitive value; strings have their length before content */
+const uint8_t *DataDecoder::value_size(uint8_t type, const uint8_t *ptr, const uint8_t *end, size_t *size) {
+  switch (type) {
+    case TYPE_BIT_STRING:
+      if ((ptr = length(ptr, end, size)) != nullptr)
+        *size = (*size + 7) / 8;
+      return ptr;
+    case TYPE_OCTET_STRING:
+    case TYPE_VISIBLE_STRING:
+    case TYPE_UTF8_STRING:
+      return length(ptr, end, size);
+    case TYPE_NULL:
+      *size = 0;
+      break;
+    case TYPE_BOOLEAN:
+    case TYPE_BCD:
+    case TYPE_SIGNED_8:
+    case TYPE_UNSIGNED_8:
+    case TYPE_ENUM:
+      *size = 1;
+      break;
+    case TYPE_SIGNED_16:
+    case TYPE_UNSIGNED_16:
+      *size = 2;
+      break;
+    case TYPE_SIGNED_32:
+    case TYPE_UNSIGNED_32:
+    case TYPE_FLOAT_32:
+    case TYPE_TIME:
+      *size = 4;
+      break;
+    case TYPE_DATE:
+      *size = 5;
+      break;
+    case TYPE_SIGNED_64:
+    case TYPE_UNSIGNED_64:
+    case TYPE_FLOAT_64:
+      *size = 8;
+      break;
+    case TYPE_DATE_TIME:
+      *size = 12;
+      break;
+    default:
+      return nullptr;
+  }
+  return ptr;
+}
+
+/* value of integer, enum, boolean or float */
+bool DataDecoder::number(const data_value_t &value, double *result) {
+  bool is_signed = false;
+  switch (value.type) {
+    case TYPE_SIGNED_8:
+    case TYPE_SIGNED_16:
+    case TYPE_SIGNED_32:
+    case TYPE_SIGNED_64:
+      is_signed = true;
+      break;
+    case TYPE_BOOLEAN:
+    case TYPE_UNSIGNED_8:
+    case TYPE_ENUM:
+    case TYPE_UNSIGNED_16:
+    case TYPE_UNSIGNED_32:
+    case TYPE_UNSIGNED_64:
+    case TYPE_FLOAT_32:
+    case TYPE_FLOAT_64:
+      break;
+    default:
+      return false;
+  }
+  uint64_t raw = 0;
+  for (size_t i = 0; i < value.size; i++)
+    raw = (raw << 8) | value.data[i];
+  if (value.type == TYPE_FLOAT_32) {
+    uint32_t bits = raw;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    *result = f;
+  } else if (value.type == TYPE_FLOAT_64) {
+    memcpy(result, &raw, sizeof(*result));
+  } else if (is_signed) {
+    uint8_t shift = 64 - value.size * 8;
+    *result = (double) ((int64_t) (raw << shift) >> shift);
+  } else {
+    *result = (double) raw;
+  }
+  return true;
+}
+
+/* date and time of date, date-time or octet string with date (year 2, month, day, day of week, hour, minute...) */
+bool DataDecoder::date(const data_value_t &value, struct tm *result) {
+  const uint8_t *data = value.data;
+  if ((value.type != TYPE_DATE && value.type != TYPE_DATE_TIME && value.type != TYPE_OCTET_STRING) || value.size < 4)
+    return false;
+  if (data[2] < 1 || data[2] > 12 || data[3] < 1 || data[3] > 31)  /* not specified or DST marks */
+    return false;
+  memset(result, 0, sizeof(struct tm));
+  result->tm_year = ((data[0] << 8) | data[1]) - 1900;
+  result->tm_mon = data[2] - 1;
+  result->tm_mday = data[3];
+  if (value.type != TYPE_DATE && value.size >= 8 && data[5] < 24 && data[6] < 60 && data[7] < 60) {
+    result->tm_hour = data[5];
+    result->tm_min = data[6];
+    result->tm_sec = data[7];
+  }
+  return true;
+}
+
 int CommandSNRM::fill_request(package_t *raw_package) {
   uint8_t *pkt_buff = (uint8_t*)raw_package;
   uint8_t *info_field_data = (uint8_t*) raw_package->data + 2;
@@ -235,32 +290,32 @@ int CommandSNRM::fill_request(package_t *raw_package) {
   info_field_data[info_field_len++] = 0x00;
   info_field_data[info_field_len++] = 0x05;
   info_field_data[info_field_len++] = 0x02;
-  info_field_data[info_field_len++] = (meter.max_info_field_tx >> 8) & 0xff;
-  info_field_data[info_field_len++] = meter.max_info_field_tx & 0xff;
+  info_field_data[info_field_len++] = (MAX_INFO_FIELD >> 8) & 0xff;
+  info_field_data[info_field_len++] = MAX_INFO_FIELD & 0xff;
   info_field_data[info_field_len++] = 0x06;
   info_field_data[info_field_len++] = 0x02;
-  info_field_data[info_field_len++] = (meter.max_info_field_rx >> 8) & 0xff;
-  info_field_data[info_field_len++] = meter.max_info_field_rx & 0xff;
+  info_field_data[info_field_len++] = (this->max_info_field_rx_ >> 8) & 0xff;
+  info_field_data[info_field_len++] = this->max_info_field_rx_ & 0xff;
   info_field_data[info_field_len++] = 0x07;
   info_field_data[info_field_len++] = 0x04;
-  info_field_data[info_field_len++] = (meter.window_tx >> 24) & 0xff;
-  info_field_data[info_field_len++] = (meter.window_tx >> 16) & 0xff;
-  info_field_data[info_field_len++] = (meter.window_tx >> 8) & 0xff;
-  info_field_data[info_field_len++] = meter.window_tx & 0xff;
+  info_field_data[info_field_len++] = 0;
+  info_field_data[info_field_len++] = 0;
+  info_field_data[info_field_len++] = 0;
+  info_field_data[info_field_len++] = 1;       /* requests are sent by one frame */
   info_field_data[info_field_len++] = 0x08;
   info_field_data[info_field_len++] = 0x04;
-  info_field_data[info_field_len++] = (meter.window_rx >> 24) & 0xff;
-  info_field_data[info_field_len++] = (meter.window_rx >> 16) & 0xff;
-  info_field_data[info_field_len++] = (meter.window_rx >> 8) & 0xff;
-  info_field_data[info_field_len++] = meter.window_rx & 0xff;
+  info_field_data[info_field_len++] = 0;
+  info_field_data[info_field_len++] = 0;
+  info_field_data[info_field_len++] = 0;
+  info_field_data[info_field_len++] = this->window_rx_;
   info_field_data[2] = info_field_len-3;
 
   uint8_t hcs_len = set_header(raw_package) + 1;
   raw_package->header.control = SNRM;
-  meter.format.length += 3;                       /* + size command + size HCS   */
-  meter.format.length += info_field_len + 2;      /* + size FCS                   */
+  this->meter_->format.length += 3;                       /* + size command + size HCS   */
+  this->meter_->format.length += info_field_len + 2;      /* + size FCS                   */
 
-  uint8_t *format = (uint8_t*)&(meter.format);
+  uint8_t *format = (uint8_t*)&(this->meter_->format);
   raw_package->header.format[0] = format[1];
   raw_package->header.format[1] = format[0];
 
@@ -268,12 +323,45 @@ int CommandSNRM::fill_request(package_t *raw_package) {
   raw_package->data[1] = (crc >> 8) & 0xff;
   raw_package->data[0] = crc & 0xff;
 
-  crc = checksum(pkt_buff + 1, meter.format.length - 2);
+  crc = checksum(pkt_buff + 1, this->meter_->format.length - 2);
   raw_package->data[info_field_len + 2] = crc & 0xff;
   raw_package->data[info_field_len + 3] = (crc >> 8) & 0xff;
   raw_package->data[info_field_len + 4] = FLAG;
 
-  return meter.format.length + 2;
+  return this->meter_->format.length + 2;
+}
+
+/* UA carries parameters of meter side (its transmit is our receive); absent parameters are HDLC defaults */
+bool CommandSNRM::process_result(header_t *header, result_package_t *package) {
+  if (header->control != UA)
+    return false;
+  uint32_t rx = MAX_INFO_FIELD, tx = MAX_INFO_FIELD, window_rx = 1, window_tx = 1;
+  const uint8_t *ptr = package->buff, *end = package->buff + package->size;
+  if (package->size >= 3 && ptr[0] == 0x81 && ptr[1] == 0x80) {
+    end = std::min(end, ptr + 3 + ptr[2]);
+    ptr += 3;
+    while (end - ptr >= 2) {
+      uint8_t id = *ptr++, len = *ptr++;
+      uint32_t value = 0;
+      if (len > 4 || end - ptr < len)
+        break;
+      for (; len > 0; len--)
+        value = (value << 8) | *ptr++;
+      switch (id) {
+        case 0x05: rx = value; break;
+        case 0x06: tx = value; break;
+        case 0x07: window_rx = value; break;
+        case 0x08: window_tx = value; break;
+      }
+    }
+  }
+  this->meter_->max_info_field_rx = std::min<uint32_t>(rx, this->max_info_field_rx_);
+  this->meter_->max_info_field_tx = std::min<uint32_t>(tx, MAX_INFO_FIELD);
+  this->meter_->window_rx = std::max<uint32_t>(1, std::min<uint32_t>(window_rx, this->window_rx_));
+  this->meter_->window_tx = 1;
+  ESP_LOGD(TAG, "Negotiated max information field %d bytes, window %d (meter offered %d/%d)",
+           this->meter_->max_info_field_rx, this->meter_->window_rx, rx, window_rx);
+  return true;
 }
 
 int CommandOpenSession::fill_request(package_t *raw_package) {
@@ -311,13 +399,13 @@ int CommandOpenSession::fill_request(package_t *raw_package) {
   info_field_data[info_field_len++] = 0x03;
   aarq_len++;
   auth_len++;
-  info_field_data[info_field_len++] = meter.password[0];
+  info_field_data[info_field_len++] = this->meter_->password[0];
   aarq_len++;
   auth_len++;
-  info_field_data[info_field_len++] = meter.password[1];
+  info_field_data[info_field_len++] = this->meter_->password[1];
   aarq_len++;
   auth_len++;
-  info_field_data[info_field_len++] = meter.password[2];
+  info_field_data[info_field_len++] = this->meter_->password[2];
   aarq_len++;
   auth_len++;
   info_field_data[auth_len_idx] = auth_len;
@@ -327,12 +415,12 @@ int CommandOpenSession::fill_request(package_t *raw_package) {
   info_field_data[aarq_len_idx] = aarq_len;
 
   uint8_t hcs_len = set_header(raw_package) + 1;
-  raw_package->header.control = 0x10; //(((meter.rrr << 5) + (meter.sss << 1)) | 0x10) & 0xFE;
-  meter.format.length += 3;                       /* + size command + size HCS   */
+  raw_package->header.control = 0x10; //(((this->meter_->rrr << 5) + (this->meter_->sss << 1)) | 0x10) & 0xFE;
+  this->meter_->format.length += 3;                       /* + size command + size HCS   */
 
-  meter.format.length += info_field_len + 2;      /* + size FCS                   */
+  this->meter_->format.length += info_field_len + 2;      /* + size FCS                   */
 
-  uint8_t *format = (uint8_t*)&(meter.format);
+  uint8_t *format = (uint8_t*)&(this->meter_->format);
 
   raw_package->header.format[0] = format[1];
   raw_package->header.format[1] = format[0];
@@ -342,12 +430,12 @@ int CommandOpenSession::fill_request(package_t *raw_package) {
   raw_package->data[1] = (crc >> 8) & 0xff;
   raw_package->data[0] = crc & 0xff;
 
-  crc = checksum(pkt_buff + 1, meter.format.length - 2);
+  crc = checksum(pkt_buff + 1, this->meter_->format.length - 2);
   raw_package->data[info_field_len + 2] = crc & 0xff;
   raw_package->data[info_field_len + 3] = (crc >> 8) & 0xff;
   raw_package->data[info_field_len + 4] = FLAG;
 
-  return meter.format.length + 2;
+  return this->meter_->format.length + 2;
 }
 
 bool CommandOpenSession::process_result(header_t *header, result_package_t *package) {
@@ -370,108 +458,473 @@ int CommandDisconnect::fill_request(package_t *raw_package) {
 
   set_header(raw_package);
   raw_package->header.control = DISC;
-  meter.format.length += 3;                       /* + size command + size FCS   */
+  this->meter_->format.length += 3;                       /* + size command + size FCS   */
 
-  uint8_t *format = (uint8_t*)&(meter.format);
+  uint8_t *format = (uint8_t*)&(this->meter_->format);
   raw_package->header.format[0] = format[1];
   raw_package->header.format[1] = format[0];
 
-  uint16_t crc = checksum(pkt_buff + 1, meter.format.length - 2);
+  uint16_t crc = checksum(pkt_buff + 1, this->meter_->format.length - 2);
   raw_package->data[0] = crc & 0xff;
   raw_package->data[1] = (crc >> 8) & 0xff;
   raw_package->data[2] = FLAG;
-  return meter.format.length + 2;
+  return this->meter_->format.length + 2;
 }
 
+int CommandKeepAlive::fill_request(package_t *raw_package) {
+  uint8_t *pkt_buff = (uint8_t*)raw_package;
 
-bool CommandGetSerialNumber::process_result(header_t *header, result_package_t *package) {
-  uint8_t *ptr = package->buff;
-  type_digit_t *unsigned32;
-  if ((*ptr++ == LSAP) && (*ptr++ == RESP_LSAP) && *ptr++ == 0 && *ptr == GET_RESPONSE && (unsigned32 = (type_digit_t*)(ptr + 4))->type == TYPE_UNSIGNED_32) {
-    number = reverse32(unsigned32->value);
-    return true;
-  }
-  return false;
+  set_header(raw_package);
+  raw_package->header.control = ((((this->meter_->sss + 1) & 0x07) << 5) | RR);  /* N(R) = next expected N(S) of meter */
+  this->meter_->format.length += 3;                       /* + size command + size FCS   */
+
+  uint8_t *format = (uint8_t*)&(this->meter_->format);
+  raw_package->header.format[0] = format[1];
+  raw_package->header.format[1] = format[0];
+
+  uint16_t crc = checksum(pkt_buff + 1, this->meter_->format.length - 2);
+  raw_package->data[0] = crc & 0xff;
+  raw_package->data[1] = (crc >> 8) & 0xff;
+  raw_package->data[2] = FLAG;
+  return this->meter_->format.length + 2;
 }
 
-bool CommandGetReleaseDate::process_result(header_t *header, result_package_t *package) {
-  uint8_t *ptr = package->buff;
-  type_octet_string_t *o_str;
-  char tmp[32];
-  if ((*ptr++ == LSAP) && (*ptr++ == RESP_LSAP) && *ptr++ == 0 && *ptr == GET_RESPONSE && (o_str = (type_octet_string_t*)(ptr + 4))->type == TYPE_OCTET_STRING && o_str->size > 0) {
-    uint8_t *ptr = &o_str->str;
-    snprintf(tmp, sizeof(tmp), "%d.%02d.%02d", (uint16_t)((*ptr++) << 8) + *ptr++, *ptr++, *ptr++);
+bool AttributeSerialNumber::decode(const uint8_t *data, const uint8_t *end) {
+  bool decoded = false;
+  DataDecoder::decode(data, end, [this, &decoded](const data_path_t &path, const data_value_t &value) {
+    double n;
+    if (path.depth != 0) {
+      return;
+    } else if (value.type == TYPE_OCTET_STRING || value.type == TYPE_VISIBLE_STRING) {
+      number = std::string((const char*) value.data, value.size);
+      decoded = true;
+    } else if (DataDecoder::number(value, &n)) {
+      number = std::to_string((uint64_t) n);
+      decoded = true;
+    }
+  });
+  return decoded;
+}
+
+bool AttributeReleaseDate::decode(const uint8_t *data, const uint8_t *end) {
+  struct tm time;
+  bool decoded = false;
+  DataDecoder::decode(data, end, [&time, &decoded](const data_path_t &path, const data_value_t &value) {
+    decoded = path.depth == 0 && DataDecoder::date(value, &time);
+  });
+  if (decoded) {
+    char tmp[32];
+    snprintf(tmp, sizeof(tmp), "%d.%02d.%02d", time.tm_year + 1900, time.tm_mon + 1, time.tm_mday);
     date = std::string(tmp);
-    return true;
   }
-  return false;
+  return decoded;
 }
 
-bool CommandGetListData::process_result(header_t *header, result_package_t *package) {
-  uint8_t *ptr = package->buff;
-  type_octet_string_t *present_date = (type_octet_string_t*)ptr;
-  // char date[32];
-  if ((*ptr++ == LSAP) && (*ptr++ == RESP_LSAP) && *ptr++ == 0 && *ptr == GET_RESPONSE && (present_date = (type_octet_string_t*)(ptr + 8))->type == TYPE_OCTET_STRING && present_date->size > 0) {
-    ptr = &present_date->str;
-    // snprintf(date, sizeof(date), "%d.%02d.%02d", (uint16_t)((*ptr++) << 8) + *ptr++, *ptr++, *ptr++);
-    // ESP_LOGD(TAG, "Present date: %s", date);
-    type_digit_t *p_list = (type_digit_t*)((uint8_t*)&present_date->str + present_date->size);
-    // tariffs energy
-    type_digit_t *tariff_A_p = p_list + 1;
-    for (uint8_t i = 0; i < MAX_TARIFF_COUNT; i++) {
-      type_digit_t *tariff_A_m = tariff_A_p + 9;
-      if (tariff_A_p->type != TYPE_UNSIGNED_32 || tariff_A_m->type != TYPE_UNSIGNED_32)
-        return false;
-      energy[i] = (float)(reverse32(tariff_A_p->value) + reverse32(tariff_A_m->value))/1000.0;
-      tariff_A_p++;
+bool AttributeListData::decode(const uint8_t *data, const uint8_t *end) {
+  /* array with one structure of present date and digits */
+  double import[MAX_TARIFF_COUNT], exported[MAX_TARIFF_COUNT], current, voltage, power;
+  uint16_t found = 0;
+  const uint16_t all = (1 << (2 * MAX_TARIFF_COUNT + 3)) - 1;
+  const uint8_t *next = DataDecoder::decode(data, end, [&](const data_path_t &path, const data_value_t &value) {
+    double n;
+    if (path.depth != 2 || path.index[0] != 0 || !DataDecoder::number(value, &n))
+      return;
+    uint16_t field = path.index[1];
+    if (field >= LIST_ENERGY_IMPORT && field < LIST_ENERGY_IMPORT + MAX_TARIFF_COUNT) {
+      import[field - LIST_ENERGY_IMPORT] = n;
+      found |= 1 << (field - LIST_ENERGY_IMPORT);
+    } else if (field >= LIST_ENERGY_EXPORT && field < LIST_ENERGY_EXPORT + MAX_TARIFF_COUNT) {
+      exported[field - LIST_ENERGY_EXPORT] = n;
+      found |= 1 << (MAX_TARIFF_COUNT + field - LIST_ENERGY_EXPORT);
+    } else if (field == LIST_CURRENT) {
+      current = n;
+      found |= 1 << (2 * MAX_TARIFF_COUNT);
+    } else if (field == LIST_VOLTAGE) {
+      voltage = n;
+      found |= 1 << (2 * MAX_TARIFF_COUNT + 1);
+    } else if (field == LIST_POWER) {
+      power = n;
+      found |= 1 << (2 * MAX_TARIFF_COUNT + 2);
     }
-    // current, voltage, power
-    p_list += 39;
-    for (uint8_t i = 0; i < 3; i++) {
-      if (p_list->type != (i == 0 ? TYPE_SIGNED_32 : TYPE_UNSIGNED_32))
-        return false;
-      cvp[i] = (float)reverse32(p_list->value) / 1000.0;
-      p_list += (i == 0 ? 3 : 2);
+  });
+  if (next == nullptr || found != all) {
+    ESP_LOGV(TAG, "List data is incomplete (fields mask 0x%03X)", found);
+    return false;
+  }
+  for (uint8_t i = 0; i < MAX_TARIFF_COUNT; i++)
+    energy[i] = (float) ((import[i] + exported[i]) / 1000.0);
+  cvp[0] = (float) (current / 1000.0);
+  cvp[1] = (float) (voltage / 1000.0);
+  cvp[2] = (float) (power / 1000.0);
+  return true;
+}
+
+bool AttributeSensor::decode(const uint8_t *data, const uint8_t *end) {
+  bool decoded = false;
+  DataDecoder::decode(data, end, [this, &decoded](const data_path_t &path, const data_value_t &value) {
+    double n;
+    if (path.depth == 0 && DataDecoder::number(value, &n)) {
+      this->value_ = n * this->multiplier_;
+      decoded = true;
     }
-    return true;
+  });
+  return decoded;
+}
+
+/* attributes are added while request fits into max information field and transmit buffer */
+bool CommandGetWithList::add_attribute(Attribute *attribute, uint16_t max_info_field) {
+  uint16_t max_len = std::min<uint16_t>(max_info_field, PKT_BUFF_MAX_LEN * 2 - 5);   /* - HCS 2, FCS 2, flag */
+  if (!this->attributes_.empty() && GET_LIST_HEADER + sizeof(request_t) * (this->attributes_.size() + 1) > max_len)
+    return false;
+  if (this->get_publish_size() + attribute->get_publish_size() > UINT8_MAX || this->attributes_.size() >= 0x7f)
+    return false;
+  this->attributes_.push_back(attribute);
+  this->set_publish_size(this->get_publish_size() + attribute->get_publish_size());
+  return true;
+}
+
+int CommandGetWithList::fill_request(package_t *raw_package) {
+  uint8_t *info_field_data = (uint8_t*) raw_package->data + 2;
+  uint8_t info_field_len = 0;
+
+  info_field_data[info_field_len++] = LSAP;
+  info_field_data[info_field_len++] = CMD_LSAP;
+  info_field_data[info_field_len++] = 0;
+  info_field_data[info_field_len++] = GET_REQUEST;
+  if (this->attributes_.size() == 1) {
+    info_field_data[info_field_len++] = GET_NORMAL;
+    info_field_data[info_field_len++] = INVOKE_ID;
+  } else {
+    info_field_data[info_field_len++] = GET_WITH_LIST;
+    info_field_data[info_field_len++] = INVOKE_ID;
+    info_field_data[info_field_len++] = this->attributes_.size();
   }
-  return false;
+  for (auto *attribute : this->attributes_) {
+    memcpy(info_field_data + info_field_len, attribute->get_descriptor(), sizeof(request_t));
+    info_field_len += sizeof(request_t);
+  }
+  return this->fill_info_request(raw_package, info_field_len);
 }
 
+bool CommandGetWithList::process_result(header_t *header, result_package_t *package) {
+  const uint8_t *ptr = package->buff, *end = package->buff + package->size;
+  size_t count = 1;
+  bool received = false;
+
+  for (auto *attribute : this->attributes_)
+    attribute->set_received(false);
+  if (package->size < 7 || *ptr++ != LSAP || *ptr++ != RESP_LSAP || *ptr++ != 0 || *ptr++ != GET_RESPONSE)
+    return false;
+  uint8_t type = *ptr++;
+  ptr++; /* invoke-id-and-priority */
+  if (type == GET_WITH_LIST)
+    ptr = DataDecoder::length(ptr, end, &count);
+  else if (type != GET_NORMAL)
+    return false;
+  if (ptr == nullptr || count != this->attributes_.size()) {
+    ESP_LOGW(TAG, "Unexpected GET response (type %d) for command [%s]", type, this->get_name().c_str());
+    return false;
+  }
+
+  for (auto *attribute : this->attributes_) {
+    const uint8_t *obis = attribute->get_descriptor()->obis;
+    if (end - ptr < 2)
+      return false;
+    if (*ptr++ != 0) { /* data-access-result instead of data */
+      ESP_LOGW(TAG, "Access to %d.%d.%d.%d.%d.%d failed with result %d", obis[0], obis[1], obis[2], obis[3], obis[4], obis[5], *ptr);
+      ptr++;
+      continue;
+    }
+    const uint8_t *next = DataDecoder::skip(ptr, end);
+    if (next == nullptr) {
+      ESP_LOGW(TAG, "Unsupported data (type %d) of %d.%d.%d.%d.%d.%d", *ptr, obis[0], obis[1], obis[2], obis[3], obis[4], obis[5]);
+      return received;
+    }
+    if (attribute->decode(ptr, next)) {
+      attribute->set_received(true);
+      received = true;
+    } else {
+      ESP_LOGW(TAG, "Failed to decode data (type %d) of %d.%d.%d.%d.%d.%d", *ptr, obis[0], obis[1], obis[2], obis[3], obis[4], obis[5]);
+    }
+    ptr = next;
+  }
+  return received;
+}
 
-Nartis100::Nartis100(uart::UARTComponent *uart, const std::string &password) : uart::UARTDevice(uart) {
+/* `counter` runs over publish steps of all attributes; not received attributes are skipped */
+void CommandGetWithList::publish_attribute(uint8_t counter) {
+  for (auto *attribute : this->attributes_) {
+    if (counter < attribute->get_publish_size()) {
+      if (attribute->is_received())
+        attribute->publish(counter);
+      return;
+    }
+    counter -= attribute->get_publish_size();
+  }
+}
+
+static std::string obis_to_string(const uint8_t *obis) {
+  char tmp[24];
+  snprintf(tmp, sizeof(tmp), "%d.%d.%d.%d.%d.%d", obis[0], obis[1], obis[2], obis[3], obis[4], obis[5]);
+  return std::string(tmp);
+}
+
+CommandGetProfile::CommandGetProfile(const std::vector<uint8_t> &obis) : Command("get_profile") {
+  this->descriptor_ = {
+    .clazz =     {0x00, 0x07},
+    .obis =      {0},
+    .attribute = {0x02, 0x00}                   /* buffer */
+  };
+  memcpy(this->descriptor_.obis, obis.data(), std::min(obis.size(), sizeof(this->descriptor_.obis)));
+  this->get_name() += "_" + obis_to_string(this->descriptor_.obis);
+}
+
+/* cursor is kept per meter: several meters on one UART can read the same profile */
+void CommandGetProfile::restore_cursor(const std::string &key) {
+  this->pref_ = global_preferences->make_preference<uint32_t>(fnv1_hash("nartis100_" + key + "_" + this->get_name()));
+  if (!this->pref_.load(&this->cursor_))
+    this->cursor_ = 0;
+  ESP_LOGD(TAG, "Restored cursor %u for command [%s]", this->cursor_, this->get_name().c_str());
+}
+
+void CommandGetProfile::dump_config() {
+  ESP_LOGCONFIG(TAG, "  Profile %s:", obis_to_string(this->descriptor_.obis).c_str());
+  ESP_LOGCONFIG(TAG, "    Max Span: %u s", this->max_span_);
+  ESP_LOGCONFIG(TAG, "    Backfill: %u s", this->backfill_);
+  ESP_LOGCONFIG(TAG, "    Max Requests: %d", this->max_requests_);
+}
+
+void CommandGetProfile::begin() {
+  this->state_ = PROFILE_CLOCK;
+  this->requests_ = 0;
+}
+
+/* seconds since 1970 of meter time as is (without time zone) */
+uint32_t CommandGetProfile::to_seconds(const struct tm &time) {
+  int32_t year = time.tm_year + 1900, month = time.tm_mon + 1;
+  year -= month <= 2;
+  int32_t era = year / 400, yoe = year - era * 400;
+  int32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + time.tm_mday - 1;
+  int32_t days = era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+  return days * 86400 + time.tm_hour * 3600 + time.tm_min * 60 + time.tm_sec;
+}
+
+/* DLMS date-time (12 bytes) of seconds since 1970 */
+uint8_t CommandGetProfile::to_date_time(uint32_t seconds, uint8_t *buff) {
+  uint32_t days = seconds / 86400, rest = seconds % 86400;
+  uint32_t z = days + 719468, era = z / 146097, doe = z - era * 146097;
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100), mp = (5 * doy + 2) / 153;
+  uint32_t day = doy - (153 * mp + 2) / 5 + 1, month = mp < 10 ? mp + 3 : mp - 9;
+  uint32_t year = yoe + era * 400 + (month <= 2);
+  uint8_t len = 0;
+  buff[len++] = (year >> 8) & 0xff;
+  buff[len++] = year & 0xff;
+  buff[len++] = month;
+  buff[len++] = day;
+  buff[len++] = (days + 3) % 7 + 1;             /* 1 - monday, 1970-01-01 is thursday */
+  buff[len++] = rest / 3600;
+  buff[len++] = (rest / 60) % 60;
+  buff[len++] = rest % 60;
+  buff[len++] = 0x00;                           /* hundredths */
+  buff[len++] = 0x80;                           /* deviation not specified */
+  buff[len++] = 0x00;
+  buff[len++] = 0x00;                           /* clock status */
+  return len;
+}
+
+int CommandGetProfile::fill_request(package_t *raw_package) {
+  uint8_t *info_field_data = (uint8_t*) raw_package->data + 2;
+  uint8_t info_field_len = 0;
+
+  info_field_data[info_field_len++] = LSAP;
+  info_field_data[info_field_len++] = CMD_LSAP;
+  info_field_data[info_field_len++] = 0;
+  info_field_data[info_field_len++] = GET_REQUEST;
+  info_field_data[info_field_len++] = GET_NORMAL;
+  info_field_data[info_field_len++] = INVOKE_ID;
+  if (this->state_ == PROFILE_CLOCK) {
+    memcpy(info_field_data + info_field_len, &attr_descriptor_clock, sizeof(request_t));
+    info_field_len += sizeof(request_t);
+    return this->fill_info_request(raw_package, info_field_len);
+  }
+
+  uint32_t from = this->cursor_ + 1;
+  this->range_to_ = this->meter_time_ - this->cursor_ > this->span_ ? this->cursor_ + this->span_ : this->meter_time_;
+  memcpy(info_field_data + info_field_len, &this->descriptor_, sizeof(request_t) - 1);
+  info_field_len += sizeof(request_t) - 1;
+  info_field_data[info_field_len++] = 0x01;    /* access selection */
+  info_field_data[info_field_len++] = ACCESS_RANGE;
+  info_field_data[info_field_len++] = TYPE_STRUCTURE;
+  info_field_data[info_field_len++] = 4;
+  /* restricting object: value of clock */
+  info_field_data[info_field_len++] = TYPE_STRUCTURE;
+  info_field_data[info_field_len++] = 4;
+  info_field_data[info_field_len++] = TYPE_UNSIGNED_16;
+  memcpy(info_field_data + info_field_len, attr_descriptor_clock.clazz, sizeof(attr_descriptor_clock.clazz));
+  info_field_len += sizeof(attr_descriptor_clock.clazz);
+  info_field_data[info_field_len++] = TYPE_OCTET_STRING;
+  info_field_data[info_field_len++] = sizeof(attr_descriptor_clock.obis);
+  memcpy(info_field_data + info_field_len, attr_descriptor_clock.obis, sizeof(attr_descriptor_clock.obis));
+  info_field_len += sizeof(attr_descriptor_clock.obis);
+  info_field_data[info_field_len++] = TYPE_SIGNED_8;
+  info_field_data[info_field_len++] = attr_descriptor_clock.attribute[0];
+  info_field_data[info_field_len++] = TYPE_UNSIGNED_16;
+  info_field_data[info_field_len++] = 0;
+  info_field_data[info_field_len++] = 0;
+  /* from and to values */
+  info_field_data[info_field_len++] = TYPE_OCTET_STRING;
+  info_field_data[info_field_len++] = 12;
+  info_field_len += to_date_time(from, info_field_data + info_field_len);
+  info_field_data[info_field_len++] = TYPE_OCTET_STRING;
+  info_field_data[info_field_len++] = 12;
+  info_field_len += to_date_time(this->range_to_, info_field_data + info_field_len);
+  /* all columns */
+  info_field_data[info_field_len++] = TYPE_ARRAY;
+  info_field_data[info_field_len++] = 0;
+  ESP_LOGV(TAG, "Requesting rows from %u to %u for command [%s]", from, this->range_to_, this->get_name().c_str());
+  return this->fill_info_request(raw_package, info_field_len);
+}
+
+bool CommandGetProfile::process_result(header_t *header, result_package_t *package) {
+  const uint8_t *ptr = package->buff, *end = package->buff + package->size;
+  if (package->size < 8 || *ptr++ != LSAP || *ptr++ != RESP_LSAP || *ptr++ != 0 || *ptr++ != GET_RESPONSE)
+    return false;
+  if (*ptr != GET_NORMAL) {
+    /* e.g. response with data blocks: range should be smaller */
+    ESP_LOGW(TAG, "Unsupported GET response type %d for command [%s]", *ptr, this->get_name().c_str());
+    this->response_too_big();
+    return false;
+  }
+  ptr += 2;  /* type, invoke-id-and-priority */
+  if (*ptr++ != 0) {
+    ESP_LOGW(TAG, "Access failed with result %d for command [%s]", *ptr, this->get_name().c_str());
+    return false;
+  }
+  return this->state_ == PROFILE_CLOCK ? this->process_clock(ptr, end) : this->process_rows(ptr, end);
+}
+
+/* smaller range is requested next time; range which does not fit even with min span is skipped,
+   otherwise the same range would be requested and fail forever */
+void CommandGetProfile::response_too_big() {
+  if (this->state_ != PROFILE_RANGE)
+    return;
+  if (this->span_ > MIN_PROFILE_SPAN) {
+    this->span_ = std::max<uint32_t>(this->span_ / 2, MIN_PROFILE_SPAN);
+    ESP_LOGW(TAG, "Response is too big, range is reduced to %u s for command [%s]", this->span_, this->get_name().c_str());
+  } else {
+    ESP_LOGW(TAG, "Response is too big, rows from %u to %u are skipped for command [%s]", this->cursor_ + 1, this->range_to_,
+             this->get_name().c_str());
+    this->cursor_ = this->range_to_;
+    this->pref_.save(&this->cursor_);
+  }
+}
+
+bool CommandGetProfile::process_clock(const uint8_t *ptr, const uint8_t *end) {
+  struct tm time;
+  bool decoded = false;
+  DataDecoder::decode(ptr, end, [&time, &decoded](const data_path_t &path, const data_value_t &value) {
+    decoded = path.depth == 0 && DataDecoder::date(value, &time);
+  });
+  if (!decoded)
+    return false;
+  this->meter_time_ = to_seconds(time);
+  // nothing was read yet or meter clock was set back
+  if (this->cursor_ == 0 || this->cursor_ > this->meter_time_) {
+    this->cursor_ = this->meter_time_ > this->backfill_ ? this->meter_time_ - this->backfill_ : 0;
+    ESP_LOGD(TAG, "Reading rows from %u for command [%s]", this->cursor_, this->get_name().c_str());
+  }
+  this->range_to_ = this->cursor_;
+  this->state_ = PROFILE_RANGE;
+  return true;
+}
+
+/* rows are array of structures with capture time in first column and values in next ones */
+bool CommandGetProfile::process_rows(const uint8_t *ptr, const uint8_t *end) {
+  uint32_t last = this->cursor_, row_time = 0;
+  uint16_t rows = 0;
+  int32_t row = -1;
+  // rows are passed to consumers only from completely valid data, so cursor and rows are always consistent
+  if (DataDecoder::skip(ptr, end) == nullptr)
+    return false;
+  auto emit_row = [&]() {
+    if (row >= 0 && row_time > this->cursor_) {
+      this->on_row_callback_.call(row_time, this->row_values_);
+      last = std::max(last, row_time);
+      rows++;
+    }
+  };
+  DataDecoder::decode(ptr, end, [&](const data_path_t &path, const data_value_t &value) {
+    struct tm time;
+    double n;
+    if (path.depth != 2)
+      return;
+    if (path.index[0] != row) {
+      emit_row();
+      row = path.index[0];
+      row_time = 0;
+      this->row_values_.clear();
+    }
+    if (path.index[1] == 0) {
+      if (DataDecoder::date(value, &time))
+        row_time = to_seconds(time);
+    } else {
+      this->row_values_.push_back(DataDecoder::number(value, &n) ? (float) n : NAN);
+    }
+  });
+  emit_row();
+  this->requests_++;
+  // range completely in the past will not get new rows
+  uint32_t cursor = this->range_to_ < this->meter_time_ ? std::max(last, this->range_to_) : last;
+  ESP_LOGD(TAG, "Received %d new rows, cursor %u for command [%s]", rows, cursor, this->get_name().c_str());
+  if (cursor != this->cursor_) {
+    this->cursor_ = cursor;
+    this->pref_.save(&this->cursor_);
+  }
+  return true;
+}
+
+
+Nartis100::Nartis100(uart::UARTComponent *uart, const std::string &password) : uart::UARTDevice(uart), transaction_(uart) {
   rx_buffer_ = (uint8_t*)&rx_package_;
   tx_buffer_ = (uint8_t*)&tx_package_;
 
-  memset(&meter, 0, sizeof(meter_t));
-  meter.client_addr = CLIENT_ADDRESS;
-  meter.server_upper_addr = LOGICAL_DEVICE;
-  meter.server_lower_addr = PHY_DEVICE;
-  meter.max_info_field_rx = MAX_INFO_FIELD;
-  meter.max_info_field_tx = MAX_INFO_FIELD;
-  meter.window_rx = 1;
-  meter.window_tx = 1;
-  meter.format.type = TYPE3;
-  memcpy(&meter.password, password.c_str(), std::min(sizeof(meter.password), strlen(password.c_str())));
+  memset(&this->meter_, 0, sizeof(meter_t));
+  this->meter_.client_addr = CLIENT_ADDRESS;
+  this->meter_.server_upper_addr = LOGICAL_DEVICE;
+  this->meter_.server_lower_addr = PHY_DEVICE;
+  this->meter_.max_info_field_rx = MAX_INFO_FIELD;
+  this->meter_.max_info_field_tx = MAX_INFO_FIELD;
+  this->meter_.window_rx = 1;
+  this->meter_.window_tx = 1;
+  this->meter_.format.type = TYPE3;
+  memcpy(&this->meter_.password, password.c_str(), std::min(sizeof(this->meter_.password), strlen(password.c_str())));
   for (uint8_t i = 0; i < MAX_TARIFF_COUNT; i++)
     this->sensor_energy_[i] = nullptr;
 }
 
 void Nartis100::setup() {
   this->phase_ = 0;
+  this->result_buffer_.resize(this->max_response_size_);
+  this->result_package_.buff = this->result_buffer_.data();
+  this->result_package_.capacity = this->result_buffer_.size();
   if (this->dir_pin_) {
     this->dir_pin_->setup();
     this->dir_pin_->digital_write(false);
+    this->transaction_.set_dir_pin(this->dir_pin_);
   }
   // read old unknown/unused data
   /*while (this->available())
     this->read();*/
 
-  this->commands_.push_back(new CommandSNRM());
-  this->commands_.push_back(new CommandOpenSession());
-  if (this->sensor_serial_number_) this->commands_.push_back(new CommandGetSerialNumber([this](const std::string &number) { this->sensor_serial_number_->publish_state(number); }));
-  if (this->sensor_release_date_) this->commands_.push_back(new CommandGetReleaseDate([this](const std::string &date) { this->sensor_release_date_->publish_state(date); }));
-  this->commands_.push_back(new CommandGetListData([this](uint8_t counter, float c, float v, float p, float t1, float t2, float t3, float t4) {
+  if (this->keep_session_) this->add_command(new CommandKeepAlive());
+  // frame of negotiated size must fit into result buffer together with FCS 2 + flag 1
+  uint16_t max_info_field = std::min<uint16_t>(this->max_info_field_, this->max_response_size_ - 3);
+  this->add_command(new CommandSNRM(max_info_field, this->window_));
+  this->add_command(new CommandOpenSession());
+  if (this->sensor_serial_number_) this->add_attribute(new AttributeSerialNumber([this](const std::string &number) { this->sensor_serial_number_->publish_state(number); }), true);
+  if (this->sensor_release_date_) this->add_attribute(new AttributeReleaseDate([this](const std::string &date) { this->sensor_release_date_->publish_state(date); }), true);
+  this->add_attribute(new AttributeListData([this](uint8_t counter, float c, float v, float p, float t1, float t2, float t3, float t4) {
     if (counter == 0 && this->sensor_current_) this->sensor_current_->publish_state(c);
     if (counter == 1 && this->sensor_voltage_) this->sensor_voltage_->publish_state(v);
     if (counter == 2 && this->sensor_power_) this->sensor_power_->publish_state(p);
@@ -479,8 +932,14 @@ void Nartis100::setup() {
     if (counter == 4 && this->sensor_energy_[1]) this->sensor_energy_[1]->publish_state(t2);
     if (counter == 5 && this->sensor_energy_[2]) this->sensor_energy_[2]->publish_state(t3);
     if (counter == 6 && this->sensor_energy_[3]) this->sensor_energy_[3]->publish_state(t4);
-  } ));
-  this->commands_.push_back(new CommandDisconnect());
+  } ), false);
+  for (auto *obis_sensor : this->obis_sensors_)
+    this->add_attribute(obis_sensor, false);
+  for (auto *profile : this->profiles_) {
+    profile->restore_cursor(this->pref_key_);
+    this->add_command(profile);
+  }
+  this->add_command(new CommandDisconnect());
 
   // startup delay
   delay(this->startup_delay_);
@@ -488,6 +947,7 @@ void Nartis100::setup() {
 
 void Nartis100::dump_config() {
   ESP_LOGCONFIG(TAG, "Nartis-100");
+  ESP_LOGCONFIG(TAG, "  Address: %d", this->meter_.server_lower_addr);
   if (this->dir_pin_) {
     LOG_PIN("  Direction Pin: ", this->dir_pin_);
   } else {
@@ -506,166 +966,328 @@ void Nartis100::dump_config() {
     LOG_SENSOR("  ", "Current Sensor", this->sensor_current_);
   if (this->sensor_power_)
     LOG_SENSOR("  ", "Power Sensor", this->sensor_power_);
+  for (auto *obis_sensor : this->obis_sensors_) {
+    const request_t *descriptor = obis_sensor->get_descriptor();
+    LOG_SENSOR("  ", "OBIS Sensor", obis_sensor->get_sensor());
+    ESP_LOGCONFIG(TAG, "    OBIS: %d.%d.%d.%d.%d.%d, class %d, attribute %d", descriptor->obis[0], descriptor->obis[1],
+                  descriptor->obis[2], descriptor->obis[3], descriptor->obis[4], descriptor->obis[5],
+                  (descriptor->clazz[0] << 8) | descriptor->clazz[1], descriptor->attribute[0]);
+  }
+  for (auto *profile : this->profiles_)
+    profile->dump_config();
   if (this->sensor_error_)
     LOG_BINARY_SENSOR("  ", "Error Sensor", this->sensor_error_);
   ESP_LOGCONFIG(TAG, "  Startup Delay: %d", this->startup_delay_);
+  ESP_LOGCONFIG(TAG, "  Max Response Size: %d", this->max_response_size_);
+  ESP_LOGCONFIG(TAG, "  Max Information Field: %d, Window: %d", this->max_info_field_, this->window_);
+  ESP_LOGCONFIG(TAG, "  Keep Session: %s", YESNO(this->keep_session_));
+  if (this->keep_session_)
+    ESP_LOGCONFIG(TAG, "  Session Timeout: %d ms", this->session_timeout_);
   LOG_UPDATE_INTERVAL(this);
 }
 
+void Nartis100::add_obis_sensor(sensor::Sensor *sensor, uint16_t class_id, const std::vector<uint8_t> &obis, uint8_t attribute, float multiplier) {
+  request_t descriptor = {
+    .clazz =     {(uint8_t) (class_id >> 8), (uint8_t) (class_id & 0xff)},
+    .obis =      {0},
+    .attribute = {attribute, 0x00}
+  };
+  memcpy(descriptor.obis, obis.data(), std::min(obis.size(), sizeof(descriptor.obis)));
+  this->obis_sensors_.push_back(new AttributeSensor(sensor, descriptor, multiplier));
+}
+
+void Nartis100::add_command(Command *command) {
+  command->set_meter(&this->meter_);
+  this->commands_.push_back(command);
+}
+
+CommandGetProfile *Nartis100::add_profile(const std::vector<uint8_t> &obis) {
+  auto *profile = new CommandGetProfile(obis);
+  this->profiles_.push_back(profile);
+  return profile;
+}
+
+/* consecutive attributes with the same start mode share one GET-Request-With-List while it fits into
+   information field of 128 bytes, which every meter accepts before negotiation */
+void Nartis100::add_attribute(Attribute *attribute, bool on_start) {
+  if (this->last_list_command_ != nullptr && this->last_list_command_->is_on_start() == on_start &&
+      this->last_list_command_->add_attribute(attribute, MAX_INFO_FIELD))
+    return;
+  this->last_list_command_ = new CommandGetWithList(on_start ? "get_on_start" : "get_data", on_start);
+  this->last_list_command_->add_attribute(attribute, MAX_INFO_FIELD);
+  this->add_command(this->last_list_command_);
+}
+
+/* byte of received frame: header and HCS are in rx_package_, information field and FCS are received
+   directly into result buffer after data of previous segments */
+uint8_t *Nartis100::frame_byte(uint16_t idx) {
+  if (idx < INFO_OFFSET)
+    return this->rx_buffer_ + idx;
+  return this->result_package_.buff + this->result_package_.size + (idx - INFO_OFFSET);
+}
+
+void Nartis100::receive_next_frame() {
+  this->rx_bytes_received_ = 0;
+  this->rx_bytes_needed_ = MIN_FRAME_SIZE;
+  this->rx_error_ = false;
+  this->rx_too_big_ = false;
+  this->transaction_.receive_next(1000);
+}
+
+/* called by transaction for every received byte: frame is complete when length from its header is received */
+bool Nartis100::receive_byte(uint8_t c) {
+  if (this->rx_bytes_received_ == 0 && c != FLAG)
+    return false;
+  // FCS is calculated while frame is received: from format to last byte before FCS
+  uint16_t idx = this->rx_bytes_received_;
+  this->stats_.bytes++;
+  if (idx == 0)
+    this->rx_crc_.reset();
+  else if (idx < 3 || idx + 2 <= format.length)
+    this->rx_crc_.update(c);
+  *this->frame_byte(this->rx_bytes_received_++) = c;
+  if (this->rx_bytes_received_ == 3) {
+    // format field is big-endian: type (4 bits), segmentation (1 bit), length (11 bits)
+    format.type = this->rx_buffer_[1] >> 4;
+    format.segmentation = (this->rx_buffer_[1] >> 3) & 0x01;
+    format.length = ((this->rx_buffer_[1] & 0x07) << 8) | this->rx_buffer_[2];
+    uint16_t full_size = format.length + (format.segmentation ? 1 : 2);
+    ESP_LOGV(TAG, "Received header: type=0x%02X, segmentation=%s, length=%d (full_size=%d)", format.type, format.segmentation ? "yes" : "no", format.length, full_size);
+    if (format.type != TYPE3) {
+      ESP_LOGV(TAG, "Bad header type 0x%02X received. Reset rx_bytes_received counter", format.type);
+      this->stats_.bad_frames++;
+      this->rx_bytes_received_ = 0;
+      return false;
+    }
+    this->rx_bytes_needed_ = full_size;
+    // segment without closing flag has one byte less, but its information field can't be empty
+    if (this->rx_bytes_needed_ < MIN_FRAME_SIZE + format.segmentation) {
+      this->stats_.bad_frames++;
+      ESP_LOGW(TAG, "Too small frame size (%d bytes) received", this->rx_bytes_needed_);
+      this->rx_error_ = true;
+      return true;
+    } else if (this->result_package_.size + this->rx_bytes_needed_ - INFO_OFFSET > this->result_package_.capacity) {
+      this->stats_.bad_frames++;
+      ESP_LOGW(TAG, "Received too big packet (%d bytes, but max size is %d bytes)", this->result_package_.size + this->rx_bytes_needed_ - INFO_OFFSET, this->result_package_.capacity);
+      this->rx_error_ = true;
+      this->rx_too_big_ = true;
+      return true;
+    }
+  }
+  return this->rx_bytes_received_ >= this->rx_bytes_needed_;
+}
+
+bool Nartis100::need_command(Command *command) {
+  if (this->keep_alive_cycle_)
+    return command->get_session_role() == SESSION_KEEP_ALIVE;
+  switch (command->get_session_role()) {
+    case SESSION_KEEP_ALIVE:
+      return false;
+    case SESSION_OPEN:
+      return !this->keep_session_ || !this->session_open_;
+    case SESSION_CLOSE:
+      return !this->keep_session_;
+    default:
+      return !command->is_on_start() || !this->started_;
+  }
+}
+
 void Nartis100::loop() {
+  // phases which don't wait for anything are run one after another in the same loop
+  for (uint8_t i = 0; i < MAX_PHASES_PER_LOOP; i++) {
+    uint32_t phase = this->phase_;
+    this->run_phase();
+    if (this->phase_ == phase || this->phase_ == 0)
+      break;
+  }
+}
+
+void Nartis100::run_phase() {
+  // keep association open: send RR before meter inactivity timeout (with 25% margin) closes it
+  if (this->phase_ == 0 && this->keep_session_ && this->session_open_ &&
+      millis() - this->last_activity_ > this->session_timeout_ / 4 * 3) {
+    ESP_LOGV(TAG, "Sending keep-alive");
+    this->keep_alive_cycle_ = true;
+    this->error_ = false;
+    this->phase_ = 1;
+  }
   if (this->phase_ == 0 || this->sleep_time_ > millis())
     return;
 
   uint32_t phase = this->phase_ % PHASE_LENGTH;
   uint32_t cmd_idx = this->phase_ / PHASE_LENGTH;
   if (cmd_idx >= this->commands_.size() || this->error_) {
+    this->transaction_.release_bus();
     this->phase_ = 0;
+    if (this->keep_alive_cycle_) {
+      this->keep_alive_cycle_ = false;
+      if (this->error_) {
+        ESP_LOGD(TAG, "No answer for keep-alive, session will be opened again");
+        this->session_open_ = false;
+      }
+      return;
+    }
+    if (this->error_ && this->keep_session_ && this->session_open_) {
+      // meter could drop association (e.g. after power loss): open it again and repeat commands once
+      ESP_LOGD(TAG, "Kept session failed, opening new session");
+      this->session_open_ = false;
+      this->error_ = false;
+      this->phase_ = 1;
+      return;
+    }
     if (!this->error_) this->started_ = true;
+    this->session_open_ = this->keep_session_ && !this->error_;
     if (this->sensor_error_) this->sensor_error_->publish_state(this->error_);
+    ESP_LOGD(TAG, "Received %u frames (%u bytes, %.1f frames/s); errors: %u checksum, %u bad frames, %u dropped, %u timeouts",
+             this->stats_.frames, this->stats_.bytes,
+             this->stats_.exchange_time ? this->stats_.frames * 1e6f / this->stats_.exchange_time : 0.0f,
+             this->stats_.crc_errors, this->stats_.bad_frames, this->stats_.dropped, this->stats_.timeouts);
     ESP_LOGV(TAG, "All phases done");
     return;
   }
   ESP_LOGV(TAG, "Phase %d cmd [%s]", phase, this->commands_[cmd_idx]->get_name().c_str());
 
-  if (!this->commands_[cmd_idx]->is_on_start() || !this->started_) switch (phase) {
+  if (this->need_command(this->commands_[cmd_idx])) switch (phase) {
 
   case 1: { // preparing command data
+    this->transaction_.release_bus();
     memset(&this->tx_package_, 0, sizeof(this->tx_package_));
-    memset(&this->result_package_, 0, sizeof(this->result_package_));
+    this->result_package_.size = 0;
+    this->result_package_.complete = false;
+    this->commands_[cmd_idx]->begin();
     this->tx_bytes_length_ = this->commands_[cmd_idx]->fill_request(&this->tx_package_);
   } break;
 
-  case 2: { // preparing to send data
-    // read old unknown/unused data
-    uint16_t unused;
-    for (unused = 0; unused < CHUNK_SIZE && this->available(); unused++)
-      this->read();
-    if (unused > 0) {
-      ESP_LOGV(TAG, "Received %d unknown/unused bytes for command [%s]", unused, this->commands_[cmd_idx]->get_name().c_str());
-      return_to_phase(2);
-    }
-    this->tx_bytes_sent_ = this->rx_bytes_received_ = 0;
+  case 2: { // sending request
+    // wait while other meter on the same UART is sending request or receiving response
+    if (!this->transaction_.acquire_bus())
+      return;
+    this->rx_bytes_received_ = 0;
     this->rx_bytes_needed_ = this->commands_[cmd_idx]->has_response() ? MIN_FRAME_SIZE : 0;
-    this->wait_time_ = millis() + 1000; // timeout 1000 ms
+    this->rx_error_ = false;
+    this->rx_too_big_ = false;
     ESP_LOGV(TAG, "Need to send %d bytes for command [%s]", this->tx_bytes_length_, this->commands_[cmd_idx]->get_name().c_str());
+    this->transaction_.start(this->tx_buffer_, this->tx_bytes_length_, 1000,
+                             this->commands_[cmd_idx]->has_response() ? this : nullptr);
+    return_to_phase(6);
   } break;
 
-  case 3: { // set dir_pin to state SEND
-    if (this->dir_pin_) {
-      ESP_LOGV(TAG, "Set dir_pin to state SEND");
-      this->dir_pin_->digital_write(true);
-      delay(5);
-    }
-  } break;
-
-  case 4: { // sending command data
-    uint16_t bytes_to_send = std::min(this->tx_bytes_length_ - this->tx_bytes_sent_, CHUNK_SIZE);
-    ESP_LOGV(TAG, "Sending %d of %d bytes for command [%s]", bytes_to_send, this->tx_bytes_length_, this->commands_[cmd_idx]->get_name().c_str());
-    this->write_array(this->tx_buffer_ + this->tx_bytes_sent_, bytes_to_send);
-    this->flush();
-    this->tx_bytes_sent_ += bytes_to_send;
-    // exit without increasing phase when not all data was sent
-    if (this->tx_bytes_sent_ < this->tx_bytes_length_) {
+  case 6: { // waiting until request is sent and response is received
+    meter_bus::TransactionStatus status = this->transaction_.poll();
+    if (status == meter_bus::TRANSACTION_BUSY)
       return;
+    this->stats_.exchange_time += this->transaction_.get_duration();
+    if (status == meter_bus::TRANSACTION_TIMEOUT) {
+      this->stats_.timeouts++;
+      ESP_LOGD(TAG, "Timed out command [%s]", this->commands_[cmd_idx]->get_name().c_str());
+      skip_next_phases(true); // skip next phases (validating, processing, publishing)
     }
-    // all data sent
-    delay(5);
-  } break;
-
-  case 5: { // delay after command sent
-    if (this->dir_pin_) {
-      this->dir_pin_->digital_write(false);
-      ESP_LOGV(TAG, "Set dir_pin to state RECV");
-    }
-    delay(5);
-  } break;
-
-  case 6: { // receiving packet
-    for (uint16_t i = 0; i < CHUNK_SIZE && this->rx_bytes_received_ < this->rx_bytes_needed_ && this->available(); i++) {
-      uint8_t c = this->read();
-      if (this->rx_bytes_received_ == 0 && c != FLAG)
-        continue;
-      this->rx_buffer_[this->rx_bytes_received_++] = c;
-      if (this->rx_bytes_received_ == 3) {
-        uint8_t *ptr_format = (uint8_t*)&format;
-        *(ptr_format + 1) = this->rx_buffer_[1];
-        *ptr_format = this->rx_buffer_[2];
-        uint16_t full_size = format.length + (format.segmentation ? 1 : 2);
-        ESP_LOGV(TAG, "Received header: type=0x%02X, segmentation=%s, length=%d (full_size=%d)", format.type, format.segmentation ? "yes" : "no", format.length, full_size);
-        if (format.type != TYPE3) {
-          ESP_LOGV(TAG, "Bad header type 0x%02X received for command [%s]. Reset rx_bytes_received counter", format.type, this->commands_[cmd_idx]->get_name().c_str());
-          this->rx_bytes_received_ = 0;
-          return_to_phase(6);
-        }
-        this->rx_bytes_needed_ = full_size;
-        if (this->rx_bytes_needed_ < MIN_FRAME_SIZE) {
-          ESP_LOGW(TAG, "Too small frame size (%d bytes) received for command [%s]", this->rx_bytes_needed_, this->commands_[cmd_idx]->get_name().c_str());
-          skip_next_phases(true);
-        } else if (this->rx_bytes_needed_ > sizeof(package_t)) {
-          ESP_LOGW(TAG, "Too big frame size (%d bytes) received for command [%s]", this->rx_bytes_needed_, this->commands_[cmd_idx]->get_name().c_str());
-          skip_next_phases(true);
-        }
-      }
+    if (this->rx_error_) {
+      ESP_LOGW(TAG, "Bad frame received for command [%s]", this->commands_[cmd_idx]->get_name().c_str());
+      if (this->rx_too_big_)
+        this->commands_[cmd_idx]->response_too_big();
+      skip_next_phases(true);
     }
-    if (this->rx_bytes_received_ < this->rx_bytes_needed_) {
-      if (this->wait_time_ < millis()) {
-        ESP_LOGD(TAG, "Timed out command [%s]", this->commands_[cmd_idx]->get_name().c_str());
-        skip_next_phases(true); // skip next phases (validating, processing, publishing)
-      } else {
-        ESP_LOGV(TAG, "Waiting next %d bytes", this->rx_bytes_needed_ - this->rx_bytes_received_);
-        return;
-      }
-    } else if (!this->commands_[cmd_idx]->has_response()) {
+    if (!this->commands_[cmd_idx]->has_response()) {
       ESP_LOGV(TAG, "Skip all next phases for command [%s] without response", this->commands_[cmd_idx]->get_name().c_str());
       skip_next_phases(false);
     }
   } break;
 
   case 7: { // validating packet
-    uint8_t size_d, size_s;
+    uint8_t size_d, size_s, *addr = this->rx_package_.header.addr;
     uint16_t crc, check_crc, lower, upper, data_size;
-    if (!format.segmentation && this->rx_buffer_[this->rx_bytes_needed_ - 1] != FLAG) {
+    // both addresses must fill address bytes of header exactly: information field is expected at INFO_OFFSET
+    if (!format.segmentation && *this->frame_byte(this->rx_bytes_needed_ - 1) != FLAG) {
       ESP_LOGW(TAG, "Received incomplete packet for command [%s]", this->commands_[cmd_idx]->get_name().c_str());
-    } else if ((size_d = Command::get_address_size(this->rx_package_.header.addr)) == 0 || !Command::get_address(this->rx_package_.header.addr, size_d, &lower, &upper)) {
+      this->stats_.bad_frames++;
+      skip_next_phases(true);
+    } else if ((size_d = Command::get_address_size(addr, sizeof(header_t::addr))) == 0 || !Command::get_address(addr, size_d, &lower, &upper)) {
       ESP_LOGW(TAG, "Received packet with bad dest address for command [%s]", this->commands_[cmd_idx]->get_name().c_str());
+      this->stats_.bad_frames++;
+      skip_next_phases(true);
+    } else if (upper != this->meter_.client_addr) {
+      ESP_LOGW(TAG, "Received packet for other client 0x%02X for command [%s]", upper, this->commands_[cmd_idx]->get_name().c_str());
+      this->stats_.bad_frames++;
       skip_next_phases(true);
-    } else if ((size_s = Command::get_address_size(this->rx_package_.header.addr + size_d)) == 0 || !Command::get_address(this->rx_package_.header.addr + size_d, size_s, &lower, &upper)) {
+    } else if ((size_s = Command::get_address_size(addr + size_d, sizeof(header_t::addr) - size_d)) == 0 ||
+               size_d + size_s != sizeof(header_t::addr) || !Command::get_address(addr + size_d, size_s, &lower, &upper)) {
       ESP_LOGW(TAG, "Received packet with bad src address for command [%s]", this->commands_[cmd_idx]->get_name().c_str());
+      this->stats_.bad_frames++;
+      skip_next_phases(true);
+    } else if (upper != this->meter_.server_upper_addr || lower != this->meter_.server_lower_addr) {
+      // late answer of other meter on the same UART must not be taken as response (and change sequence numbers)
+      ESP_LOGW(TAG, "Received packet from other meter 0x%02X/0x%02X for command [%s]", upper, lower, this->commands_[cmd_idx]->get_name().c_str());
+      this->stats_.bad_frames++;
       skip_next_phases(true);
     }
-    crc = Command::checksum(this->rx_buffer_ + 1, format.length - 2);
-    check_crc = this->rx_buffer_[this->rx_bytes_needed_ - (format.segmentation ? 1 : 2)];
-    check_crc = (check_crc << 8) + this->rx_buffer_[this->rx_bytes_needed_ - (format.segmentation ? 2 : 3)];
+    // checksum was calculated over frame parts in rx_package_ and in result buffer while receiving
+    crc = this->rx_crc_.value() ^ 0xffff;
+    check_crc = *this->frame_byte(this->rx_bytes_needed_ - (format.segmentation ? 1 : 2));
+    check_crc = (check_crc << 8) + *this->frame_byte(this->rx_bytes_needed_ - (format.segmentation ? 2 : 3));
     data_size = this->rx_bytes_needed_ - sizeof(header_t) - (format.segmentation ? 4 : 3);
     if (crc != check_crc) {
+      this->stats_.crc_errors++;
       ESP_LOGW(TAG, "Received packet with wrong checksum (0x%04X instead of 0x%04X) for command [%s]", check_crc, crc, this->commands_[cmd_idx]->get_name().c_str());
       skip_next_phases(true);
-    } else if (this->result_package_.size + data_size > sizeof(this->result_package_.buff)) {
-      ESP_LOGW(TAG, "Received too big packet (%d bytes, but max size is %d bytes) for command [%s]", this->result_package_.size + data_size, sizeof(this->result_package_.buff), this->commands_[cmd_idx]->get_name().c_str());
-      skip_next_phases(true);
     }
     // all validations passed
+    this->stats_.frames++;
     ESP_LOGV(TAG, "Packet OK (checksum 0x%04X, data size %d bytes) for command [%s]", crc, data_size, this->commands_[cmd_idx]->get_name().c_str());
-    meter.format = format;
-    meter.rrr = (this->rx_package_.header.control >> 5) & 0x07;
-    meter.sss = (this->rx_package_.header.control >> 1) & 0x07;
-    memcpy(this->result_package_.buff + this->result_package_.size, this->rx_package_.data + 2, data_size);
+    this->meter_.format = format;
+    this->last_activity_ = millis();
+    // next segment must have next N(S): frames retransmitted by meter or out of window are dropped
+    uint8_t control = this->rx_package_.header.control, ns = (control >> 1) & 0x07;
+    if (this->result_package_.size > 0 && (control & 0x01) == 0 && ns != ((this->meter_.sss + 1) & 0x07)) {
+      this->stats_.dropped++;
+      ESP_LOGD(TAG, "Dropped segment N(S)=%d (expected %d) for command [%s]", ns, (this->meter_.sss + 1) & 0x07, this->commands_[cmd_idx]->get_name().c_str());
+      if (control & POLL_FINAL) {
+        // last frame of window: acknowledge last accepted segment, so meter repeats next ones
+        memset(&this->tx_package_, 0, sizeof(this->tx_package_));
+        this->tx_bytes_length_ = this->commands_[cmd_idx]->fill_notification_request(&this->tx_package_);
+        return_to_phase(2);
+      }
+      this->receive_next_frame();
+      return_to_phase(6);
+    }
+    // sequence numbers are taken from information frames only (RR response has no N(S))
+    if (this->commands_[cmd_idx]->get_session_role() != SESSION_KEEP_ALIVE) {
+      this->meter_.rrr = (this->rx_package_.header.control >> 5) & 0x07;
+      this->meter_.sss = (this->rx_package_.header.control >> 1) & 0x07;
+    }
+    // data is already in result buffer, so only move its end
     this->result_package_.size += data_size;
   } break;
 
   case 8: { // processing command
-    if (meter.format.segmentation) {
+    if (this->meter_.format.segmentation) {
+      if ((this->rx_package_.header.control & POLL_FINAL) == 0) {
+        // meter sends next frames of window without acknowledge
+        ESP_LOGV(TAG, "Receiving next frame of window for command [%s]", this->commands_[cmd_idx]->get_name().c_str());
+        this->receive_next_frame();
+        return_to_phase(6);
+      }
       ESP_LOGV(TAG, "Packet with segmentation for command [%s]. Sending notification command for next frame", this->commands_[cmd_idx]->get_name().c_str());
       memset(&this->tx_package_, 0, sizeof(this->tx_package_));
       this->tx_bytes_length_ = this->commands_[cmd_idx]->fill_notification_request(&this->tx_package_);
       return_to_phase(2);
     } else {
+      // response is received: next request to other meter can be sent while this one is processed
+      this->transaction_.release_bus();
       ESP_LOGV(TAG, "Processing %d bytes result for command [%s]", this->result_package_.size, this->commands_[cmd_idx]->get_name().c_str());
       this->result_package_.complete = true;
       if (!this->commands_[cmd_idx]->process_result(&this->rx_package_.header, &this->result_package_)) {
         ESP_LOGW(TAG, "Failed to process result for command [%s]", this->commands_[cmd_idx]->get_name().c_str());
         skip_next_phases(true);
       }
+      if (this->commands_[cmd_idx]->has_next_request()) {
+        ESP_LOGV(TAG, "Sending next request for command [%s]", this->commands_[cmd_idx]->get_name().c_str());
+        memset(&this->tx_package_, 0, sizeof(this->tx_package_));
+        this->result_package_.size = 0;
+        this->result_package_.complete = false;
+        this->tx_bytes_length_ = this->commands_[cmd_idx]->fill_request(&this->tx_package_);
+        return_to_phase(2);
+      }
     }
   } break;
 
@@ -1,11 +1,17 @@
 #pragma once
 
 #include "esphome/components/binary_sensor/binary_sensor.h"
+#include "esphome/components/meter_bus/checksum.h"
+#include "esphome/components/meter_bus/meter_bus.h"
 #include "esphome/components/sensor/sensor.h"
 #include "esphome/components/text_sensor/text_sensor.h"
 #include "esphome/components/uart/uart.h"
+#include "esphome/core/automation.h"
 #include "esphome/core/component.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/preferences.h"
 #include "time.h"
+#include <algorithm>
 
 namespace esphome {
 namespace nartis100 {
@@ -13,7 +19,8 @@ namespace nartis100 {
 #define MAX_TARIFF_COUNT 4
 
 #define PKT_BUFF_MAX_LEN    128         /* max len read from uart   */
-#define UART_BUFF_SIZE 512
+#define DEFAULT_MAX_RESPONSE_SIZE 512  /* default size of reassembled response  */
+#define MIN_PROFILE_SPAN    300         /* profile range is not reduced below 5 minutes */
 
 #define CLIENT_ADDRESS  0x20
 #define PHY_DEVICE      0x10
@@ -22,9 +29,12 @@ namespace nartis100 {
 #define TYPE3           0x0A
 #define MAX_INFO_FIELD  0x80
 #define MIN_FRAME_SIZE  10      /* flag 1 + format 2 + address 3 + control 1 + FCS 2 + flag = 10 byte */
+#define INFO_OFFSET     9       /* flag 1 + format 2 + address 3 + control 1 + HCS 2 */
 #define SNRM            0x93
 #define DISC            0x53
 #define UA              0x73
+#define RR              0x11    /* receive ready with poll bit, N(R) in bits 5-7 */
+#define POLL_FINAL      0x10    /* poll/final bit of control: set in last frame of window */
 #define LSAP            0xe6
 #define CMD_LSAP        LSAP
 #define RESP_LSAP       0xe7
@@ -33,11 +43,37 @@ namespace nartis100 {
 #define AUTH            0xac
 #define GET_REQUEST     0xc0
 #define GET_RESPONSE    0xc4
+#define GET_NORMAL      0x01
+#define GET_WITH_LIST   0x03
+#define INVOKE_ID       0xc1    /* invoke-id-and-priority: high priority, confirmed, id 1 */
+#define GET_LIST_HEADER 7       /* LLC 3 + GET tag, type, invoke-id 3 + count 1 */
+#define MAX_DATA_DEPTH  8       /* max nesting of arrays and structures in A-XDR data */
+#define ACCESS_RANGE    0x01    /* selective access by range of restricting object */
 
 enum {
-    TYPE_SIGNED_32    = 0x05,
-    TYPE_UNSIGNED_32  = 0x06,
-    TYPE_OCTET_STRING = 0x09
+    TYPE_NULL           = 0x00,
+    TYPE_ARRAY          = 0x01,
+    TYPE_STRUCTURE      = 0x02,
+    TYPE_BOOLEAN        = 0x03,
+    TYPE_BIT_STRING     = 0x04,
+    TYPE_SIGNED_32      = 0x05,
+    TYPE_UNSIGNED_32    = 0x06,
+    TYPE_OCTET_STRING   = 0x09,
+    TYPE_VISIBLE_STRING = 0x0a,
+    TYPE_UTF8_STRING    = 0x0c,
+    TYPE_BCD            = 0x0d,
+    TYPE_SIGNED_8       = 0x0f,
+    TYPE_SIGNED_16      = 0x10,
+    TYPE_UNSIGNED_8     = 0x11,
+    TYPE_UNSIGNED_16    = 0x12,
+    TYPE_SIGNED_64      = 0x14,
+    TYPE_UNSIGNED_64    = 0x15,
+    TYPE_ENUM           = 0x16,
+    TYPE_FLOAT_32       = 0x17,
+    TYPE_FLOAT_64       = 0x18,
+    TYPE_DATE_TIME      = 0x19,
+    TYPE_DATE           = 0x1a,
+    TYPE_TIME           = 0x1b
 };
 
 typedef struct __attribute__((packed)) {
@@ -53,6 +89,17 @@ typedef struct __attribute__((packed)) {
     uint8_t     control;                    /* control - srnm, disc, etc.               */
 } header_t;
 
+/* receive path counters since boot */
+typedef struct {
+    uint32_t    frames;                     /* valid frames                             */
+    uint32_t    bytes;                      /* all received bytes                       */
+    uint32_t    crc_errors;
+    uint32_t    bad_frames;                 /* bad type, size or address                */
+    uint32_t    dropped;                    /* out of sequence segments                 */
+    uint32_t    timeouts;
+    uint64_t    exchange_time;              /* microseconds of sending and receiving    */
+} link_stats_t;
+
 typedef struct __attribute__((packed)) {
     header_t    header;                     /* | FLAG | Format | Dest addr | Src addr | Control |   */
     uint8_t     data[PKT_BUFF_MAX_LEN*2];   /* | HCS | Information | FCS | Flag |                   */
@@ -64,16 +111,18 @@ typedef struct __attribute__((packed)) {
     uint8_t     attribute[2];
 } request_t;
 
-typedef struct __attribute__((packed)) {
-    uint8_t     type;
-    uint8_t     size;
-    uint8_t     str;
-} type_octet_string_t;
+/* primitive value of A-XDR data */
+typedef struct {
+    uint8_t         type;
+    const uint8_t   *data;                  /* big-endian value or content of string    */
+    size_t          size;                   /* size of data in bytes                    */
+} data_value_t;
 
-typedef struct __attribute__((packed)) {
-    uint8_t     type;                       /* 0x05 or 0x06 */
-    uint32_t    value;
-} type_digit_t; /* int8_t, uint8_t, int16_t, uint16_t, int32_t, uint32_t, int64_t, uint64_t */
+/* position of value in data: index of element on each level of nested arrays and structures */
+typedef struct {
+    uint8_t     depth;
+    uint16_t    index[MAX_DATA_DEPTH];
+} data_path_t;
 
 typedef struct __attribute__((packed)) {
     uint8_t     client_addr;
@@ -89,10 +138,12 @@ typedef struct __attribute__((packed)) {
     uint8_t     sss;
 } meter_t;
 
-typedef struct __attribute__((packed)) {
+/* information fields of all segments are received directly into `buff` one after another */
+typedef struct {
     size_t      size;
     uint8_t     complete;                   /* 1 - complete, 0 - not complete */
-    uint8_t     buff[UART_BUFF_SIZE];
+    uint8_t     *buff;
+    size_t      capacity;                   /* max response size                */
 } result_package_t;
 
 
@@ -114,7 +165,60 @@ static request_t attr_descriptor_list = {
     .attribute = {0x02, 0x00}
 };
 
-static meter_t meter;
+static request_t attr_descriptor_clock = {
+    .clazz  =    {0x00, 0x08},
+    .obis   =    {0x00, 0x00, 0x01, 0x00, 0x00, 0xff},   /* 0.0.1.0.0.255    */
+    .attribute = {0x02, 0x00}
+};
+
+/* single-pass A-XDR decoder without allocations: visitor is called for every primitive value with its path,
+   so fields are picked by index in structure instead of byte offset */
+class DataDecoder {
+public:
+  /* returns pointer after decoded data or nullptr for bad or unsupported data */
+  template<typename Visitor> static const uint8_t *decode(const uint8_t *ptr, const uint8_t *end, Visitor &&on_value) {
+    data_path_t path = {0, {0}};
+    return decode_value(ptr, end, path, on_value);
+  }
+  static const uint8_t *skip(const uint8_t *ptr, const uint8_t *end) {
+    return decode(ptr, end, [](const data_path_t &path, const data_value_t &value) {});
+  }
+  static const uint8_t *length(const uint8_t *ptr, const uint8_t *end, size_t *length);
+  static bool number(const data_value_t &value, double *result);
+  static bool date(const data_value_t &value, struct tm *result);
+private:
+  static const uint8_t *value_size(uint8_t type, const uint8_t *ptr, const uint8_t *end, size_t *size);
+  template<typename Visitor>
+  static const uint8_t *decode_value(const uint8_t *ptr, const uint8_t *end, data_path_t &path, Visitor &on_value) {
+    size_t size;
+    if (ptr >= end)
+      return nullptr;
+    uint8_t type = *ptr++;
+    if (type == TYPE_ARRAY || type == TYPE_STRUCTURE) {
+      if (path.depth >= MAX_DATA_DEPTH || (ptr = length(ptr, end, &size)) == nullptr)
+        return nullptr;
+      uint8_t level = path.depth++;
+      for (size_t i = 0; i < size && ptr != nullptr; i++) {
+        path.index[level] = i;
+        ptr = decode_value(ptr, end, path, on_value);
+      }
+      path.depth--;
+      return ptr;
+    }
+    if ((ptr = value_size(type, ptr, end, &size)) == nullptr || (size_t) (end - ptr) < size)
+      return nullptr;
+    on_value((const data_path_t &) path, data_value_t{type, ptr, size});
+    return ptr + size;
+  }
+};
+
+/* role of command in HDLC link and DLMS association */
+enum SessionRole : uint8_t {
+  SESSION_NONE,       /* data command */
+  SESSION_OPEN,       /* SNRM, AARQ - skipped while session is kept open */
+  SESSION_CLOSE,      /* DISC - skipped when session is kept open */
+  SESSION_KEEP_ALIVE  /* RR - sent only near meter inactivity timeout */
+};
 
 
 class Command {
@@ -124,18 +228,27 @@ public:
   std::string& get_name() { return this->name_; }
   bool is_on_start() { return this->on_start_; }
   bool has_response() { return this->has_response_; }
+  SessionRole get_session_role() { return this->session_role_; }
+  void set_meter(meter_t *meter) { this->meter_ = meter; }
   int fill_notification_request(package_t *package);
   virtual int fill_request(package_t *package) = 0;
   virtual bool process_result(header_t *header, result_package_t *package) = 0;
+  virtual void begin() {}                           /* called before first request of command */
+  virtual bool has_next_request() { return false; } /* one more request after processed result */
+  virtual void response_too_big() {}                /* response did not fit into result buffer */
   bool publish_result();
   static uint16_t checksum(const uint8_t *src_buffer, size_t len);
   static uint8_t set_address(uint8_t *buff, uint8_t len, uint16_t lower, uint16_t upper);
   static uint8_t get_address(uint8_t *buff, uint8_t len, uint16_t *lower, uint16_t *upper);
-  static uint8_t get_address_size(uint8_t *buff);
+  static uint8_t get_address_size(const uint8_t *buff, uint8_t max_len);
   static uint32_t reverse32(uint32_t in);
 protected:
   size_t set_header(package_t *raw_package);
-  int request_data(request_t *request, package_t *raw_package);
+  int fill_info_request(package_t *raw_package, uint8_t info_field_len);
+  uint8_t get_publish_size() { return this->publish_size_; }
+  void set_publish_size(uint8_t publish_size) { this->publish_size_ = publish_size; }
+  SessionRole session_role_{SESSION_NONE};
+  meter_t *meter_{nullptr};                 /* link and session state of meter the command is sent to */
 private:
   uint8_t publish_size_, publish_counter_{0};
   std::function<void(uint8_t counter)> on_publish_;
@@ -143,67 +256,173 @@ private:
   bool has_response_, on_start_;
 };
 
+/* proposes max receive information field and window, UA answer sets negotiated values of meter */
 class CommandSNRM : public Command {
 public:
-  CommandSNRM() : Command("snrm") {}
+  CommandSNRM(uint16_t max_info_field_rx, uint8_t window_rx) : Command("snrm"), max_info_field_rx_(max_info_field_rx), window_rx_(window_rx) { session_role_ = SESSION_OPEN; }
   int fill_request(package_t *package) override;
-  bool process_result(header_t *header, result_package_t *package) override { return header->control == UA; }
+  bool process_result(header_t *header, result_package_t *package) override;
+private:
+  uint16_t max_info_field_rx_;
+  uint8_t window_rx_;
 };
 
 class CommandOpenSession : public Command {
 public:
-  CommandOpenSession() : Command("open_session") {}
+  CommandOpenSession() : Command("open_session") { session_role_ = SESSION_OPEN; }
   int fill_request(package_t *package) override;
   bool process_result(header_t *header, result_package_t *package) override;
 };
 
 class CommandDisconnect : public Command {
 public:
-  CommandDisconnect() : Command("disconnect", false) {}
+  CommandDisconnect() : Command("disconnect", false) { session_role_ = SESSION_CLOSE; }
   int fill_request(package_t *package) override;
   bool process_result(header_t *header, result_package_t *package) override { return true; };
 };
 
-class CommandGetSerialNumber : public Command {
+class CommandKeepAlive : public Command {
 public:
-  CommandGetSerialNumber(std::function<void(const std::string&)> on_value) : Command("get_serial_number", true, true, 1, [this](uint8_t counter) {on_value_(std::to_string(number));}), on_value_(on_value) {}
-  int fill_request(package_t *package) override { return request_data(&attr_descriptor_serial_number, package); }
-  bool process_result(header_t *header, result_package_t *package) override;
+  CommandKeepAlive() : Command("keep_alive") { session_role_ = SESSION_KEEP_ALIVE; }
+  int fill_request(package_t *package) override;
+  bool process_result(header_t *header, result_package_t *package) override { return (header->control & 0x0F) == (RR & 0x0F); }
+};
+
+/* attribute of COSEM object: descriptor for GET request and consumer of its A-XDR encoded value */
+class Attribute {
+public:
+  Attribute(const request_t &descriptor, uint8_t publish_size = 1) : descriptor_(descriptor), publish_size_(publish_size) {}
+  const request_t *get_descriptor() { return &this->descriptor_; }
+  uint8_t get_publish_size() { return this->publish_size_; }
+  bool is_received() { return this->received_; }
+  void set_received(bool received) { this->received_ = received; }
+  virtual bool decode(const uint8_t *data, const uint8_t *end) = 0;
+  virtual void publish(uint8_t counter) = 0;
+protected:
+  request_t descriptor_;
+  uint8_t publish_size_;
+  bool received_{false};
+};
+
+class AttributeSerialNumber : public Attribute {
+public:
+  AttributeSerialNumber(std::function<void(const std::string&)> on_value) : Attribute(attr_descriptor_serial_number), on_value_(on_value) {}
+  bool decode(const uint8_t *data, const uint8_t *end) override;
+  void publish(uint8_t counter) override { on_value_(number); }
 private:
-  uint32_t number;
+  std::string number;
   std::function<void(const std::string &number)> on_value_;
 };
 
-class CommandGetReleaseDate : public Command {
+class AttributeReleaseDate : public Attribute {
 public:
-  CommandGetReleaseDate(std::function<void(const std::string&)> on_value) : Command("get_release_date", true, true, 1, [this](uint8_t counter) {on_value_(date);}), on_value_(on_value) {}
-  int fill_request(package_t *package) override { return request_data(&attr_descriptor_date_release, package); }
-  bool process_result(header_t *header, result_package_t *package) override;
+  AttributeReleaseDate(std::function<void(const std::string&)> on_value) : Attribute(attr_descriptor_date_release), on_value_(on_value) {}
+  bool decode(const uint8_t *data, const uint8_t *end) override;
+  void publish(uint8_t counter) override { on_value_(date); }
 private:
   std::string date;
   std::function<void(const std::string &number)> on_value_;
 };
 
-class CommandGetListData : public Command {
+/* fields of list 1.0.94.7.0.255 by index in its structure */
+enum ListDataField : uint16_t {
+  LIST_PRESENT_DATE   = 0,
+  LIST_ENERGY_IMPORT  = 2,    /* A+ by tariffs 1..4 */
+  LIST_ENERGY_EXPORT  = 11,   /* A- by tariffs 1..4 */
+  LIST_CURRENT        = 40,
+  LIST_VOLTAGE        = 43,
+  LIST_POWER          = 45
+};
+
+class AttributeListData : public Attribute {
 public:
-  CommandGetListData(std::function<void(uint8_t, float, float, float, float, float, float, float)> on_value)
-    : Command("get_list_data", true, false, 7, [this](uint8_t counter) {on_value_(counter, cvp[0], cvp[1], cvp[2], energy[0], energy[1], energy[2], energy[3]);}), on_value_(on_value) {}
-  int fill_request(package_t *package) override { return request_data(&attr_descriptor_list, package); }
-  bool process_result(header_t *header, result_package_t *package) override;
+  AttributeListData(std::function<void(uint8_t, float, float, float, float, float, float, float)> on_value)
+    : Attribute(attr_descriptor_list, 7), on_value_(on_value) {}
+  bool decode(const uint8_t *data, const uint8_t *end) override;
+  void publish(uint8_t counter) override { on_value_(counter, cvp[0], cvp[1], cvp[2], energy[0], energy[1], energy[2], energy[3]); }
 private:
   std::function<void(uint8_t counter, float c, float v, float p, float t1, float t2, float t3,float t4)> on_value_;
   float energy[MAX_TARIFF_COUNT], cvp[3];
 };
 
+/* numeric attribute declared in configuration by class, OBIS code and attribute index */
+class AttributeSensor : public Attribute {
+public:
+  AttributeSensor(sensor::Sensor *sensor, const request_t &descriptor, float multiplier)
+    : Attribute(descriptor), sensor_(sensor), multiplier_(multiplier) {}
+  sensor::Sensor *get_sensor() { return this->sensor_; }
+  bool decode(const uint8_t *data, const uint8_t *end) override;
+  void publish(uint8_t counter) override { this->sensor_->publish_state(this->value_); }
+private:
+  sensor::Sensor *sensor_;
+  float multiplier_, value_{NAN};
+};
 
-class Nartis100 : public PollingComponent, public uart::UARTDevice {
+/* reads attributes with one GET-Request-With-List (GET-Request-Normal for single attribute)
+   and passes every Get-Data-Result to its attribute */
+class CommandGetWithList : public Command {
+public:
+  CommandGetWithList(const std::string &name, bool on_start)
+    : Command(name, true, on_start, 0, [this](uint8_t counter) { this->publish_attribute(counter); }) {}
+  bool add_attribute(Attribute *attribute, uint16_t max_info_field);
+  int fill_request(package_t *package) override;
+  bool process_result(header_t *header, result_package_t *package) override;
+private:
+  void publish_attribute(uint8_t counter);
+  std::vector<Attribute *> attributes_;
+};
+
+/* profile-generic object read by ranges of capture time after persisted cursor: meter clock is read first,
+   then rows newer than cursor are requested with selective access by range, at most `max_span` per request */
+class CommandGetProfile : public Command {
+public:
+  CommandGetProfile(const std::vector<uint8_t> &obis);
+  void set_max_span(uint32_t max_span) { this->max_span_ = this->span_ = max_span; }
+  void set_backfill(uint32_t backfill) { this->backfill_ = backfill; }
+  void set_max_requests(uint8_t max_requests) { this->max_requests_ = max_requests; }
+  void add_on_row_callback(std::function<void(uint32_t, const std::vector<float> &)> &&callback) {
+    this->on_row_callback_.add(std::move(callback));
+  }
+  void restore_cursor(const std::string &key);
+  void dump_config();
+  void begin() override;
+  bool has_next_request() override { return this->state_ == PROFILE_RANGE && this->range_to_ < this->meter_time_ && this->requests_ < this->max_requests_; }
+  int fill_request(package_t *package) override;
+  bool process_result(header_t *header, result_package_t *package) override;
+  void response_too_big() override;
+  static uint32_t to_seconds(const struct tm &time);
+  static uint8_t to_date_time(uint32_t seconds, uint8_t *buff);
+private:
+  enum ProfileState : uint8_t { PROFILE_CLOCK, PROFILE_RANGE };
+  bool process_clock(const uint8_t *ptr, const uint8_t *end);
+  bool process_rows(const uint8_t *ptr, const uint8_t *end);
+  request_t descriptor_;
+  ProfileState state_{PROFILE_CLOCK};
+  uint32_t max_span_{6 * 3600}, span_{6 * 3600}, backfill_{24 * 3600};  /* span_ is reduced by too big responses */
+  uint8_t max_requests_{4}, requests_{0};
+  uint32_t cursor_{0}, meter_time_{0}, range_to_{0};  /* seconds since 1970 in meter time */
+  ESPPreferenceObject pref_;
+  std::vector<float> row_values_;
+  CallbackManager<void(uint32_t, const std::vector<float> &)> on_row_callback_{};
+};
+
+
+class Nartis100 : public PollingComponent, public uart::UARTDevice, public meter_bus::FrameReceiver {
 public:
   Nartis100(uart::UARTComponent *uart, const std::string &password);
   void setup() override;
   void dump_config() override;
   void loop() override;
   void update() override;
+  bool receive_byte(uint8_t c) override;
   void set_startup_delay(uint32_t startup_delay) { this->startup_delay_ = startup_delay; }
+  void set_address(uint16_t address) { this->meter_.server_lower_addr = address; }
+  void set_keep_session(bool keep_session) { this->keep_session_ = keep_session; }
+  void set_session_timeout(uint32_t session_timeout) { this->session_timeout_ = session_timeout; }
+  void set_max_response_size(uint16_t size) { this->max_response_size_ = size; }
+  void set_max_info_field(uint16_t max_info_field) { this->max_info_field_ = max_info_field; }
+  void set_window(uint8_t window) { this->window_ = window; }
+  void set_pref_key(const std::string &key) { this->pref_key_ = key; }
   void set_dir_pin(GPIOPin *pin) { this->dir_pin_ = pin; }
   void set_current_sensor(sensor::Sensor *sensor) { this->sensor_current_ = sensor; }
   void set_voltage_sensor(sensor::Sensor *sensor) { this->sensor_voltage_ = sensor; }
@@ -212,26 +431,56 @@ public:
   void set_energy_sensor(uint16_t idx, sensor::Sensor *sensor) { this->sensor_energy_[idx] = sensor; }
   void set_serial_number_sensor(text_sensor::TextSensor *sensor) { this->sensor_serial_number_ = sensor; }
   void set_release_date_sensor(text_sensor::TextSensor *sensor) { this->sensor_release_date_ = sensor; }
+  void add_obis_sensor(sensor::Sensor *sensor, uint16_t class_id, const std::vector<uint8_t> &obis, uint8_t attribute, float multiplier);
+  CommandGetProfile *add_profile(const std::vector<uint8_t> &obis);
 
 protected:
   void delay(uint32_t ms) { this->sleep_time_ = millis() + ms; }
+  void run_phase();
   uint16_t crc16(const uint8_t *data, uint16_t len);
+  bool need_command(Command *command);
+  void add_command(Command *command);
+  void add_attribute(Attribute *attribute, bool on_start);
+  uint8_t *frame_byte(uint16_t idx);
+  void receive_next_frame();
   std::vector<Command *> commands_;
+  std::vector<AttributeSensor *> obis_sensors_;
+  std::vector<CommandGetProfile *> profiles_;
+  CommandGetWithList *last_list_command_{nullptr};
 
 private:
   uint32_t startup_delay_{0}, phase_{0};
-  unsigned long sleep_time_{0}, wait_time_{0};
+  unsigned long sleep_time_{0};
   uint8_t *rx_buffer_, *tx_buffer_;
   package_t rx_package_, tx_package_;
   result_package_t result_package_;
-  uint16_t tx_bytes_length_{0}, tx_bytes_sent_{0}, rx_bytes_needed_{0}, rx_bytes_received_{0};
-  bool error_{false}, started_{false};
+  std::vector<uint8_t> result_buffer_;
+  uint16_t max_response_size_{DEFAULT_MAX_RESPONSE_SIZE};
+  uint16_t max_info_field_{MAX_INFO_FIELD};
+  uint8_t window_{1};
+  std::string pref_key_;
+  uint16_t tx_bytes_length_{0}, rx_bytes_needed_{0}, rx_bytes_received_{0};
+  bool error_{false}, started_{false}, rx_error_{false}, rx_too_big_{false};
+  bool keep_session_{false}, session_open_{false}, keep_alive_cycle_{false};
+  uint32_t session_timeout_{120000};
+  unsigned long last_activity_{0};
   GPIOPin *dir_pin_{nullptr};
+  meter_bus::Transaction transaction_;
+  meter_bus::Crc16X25 rx_crc_;
+  link_stats_t stats_{};
   binary_sensor::BinarySensor *sensor_error_{nullptr};
   sensor::Sensor *sensor_current_{nullptr}, *sensor_voltage_{nullptr}, *sensor_power_{nullptr};
   sensor::Sensor *sensor_energy_[MAX_TARIFF_COUNT];
   text_sensor::TextSensor *sensor_serial_number_{nullptr}, *sensor_release_date_{nullptr};
   format_t format;
+  meter_t meter_;
+};
+
+class ProfileRowTrigger : public Trigger<uint32_t, std::vector<float>> {
+public:
+  explicit ProfileRowTrigger(CommandGetProfile *profile) {
+    profile->add_on_row_callback([this](uint32_t timestamp, const std::vector<float> &values) { this->trigger(timestamp, values); });
+  }
 };
 
 template <typename... Ts> class Nartis100ForceUpdateAction : public Action<Ts...> {
@@ -4,7 +4,9 @@ from esphome.components import binary_sensor, sensor, switch
 from esphome.components import modbus_tcp
 from esphome.const import (
     CONF_ID,
+    CONF_BATTERY_LEVEL,
     CONF_DEVICE_ID,
+    CONF_INDEX,
     CONF_NAME,
     DEVICE_CLASS_BATTERY,
     DEVICE_CLASS_CONNECTIVITY,
@@ -12,10 +14,12 @@ from esphome.const import (
     DEVICE_CLASS_PROBLEM,
     DEVICE_CLASS_SWITCH,
     DEVICE_CLASS_WATER,
+    STATE_CLASS_MEASUREMENT,
     ENTITY_CATEGORY_CONFIG,
     ENTITY_CATEGORY_DIAGNOSTIC,
     STATE_CLASS_TOTAL_INCREASING,
     UNIT_CUBIC_METER,
+    UNIT_PERCENT,
 )
 
 DEPENDENCIES = ["modbus_tcp"]
@@ -25,6 +29,7 @@ MULTI_CONF = True
 MAX_ZONES = 2
 MAX_WIRE_LINE_LEAK_SENSORS = 4
 MAX_WATER_COUNTERS = 8
+MAX_WIRELESS_SENSORS = 50
 
 CONF_MODBUS_ID = "modbus_id"
 CONF_CONNECTION_STATUS = "connection_status"
@@ -44,16 +49,46 @@ CONF_WIRE_LINE_LEAK_ARRAY = list(map(lambda x: CONF_WIRE_LINE_LEAK + "_" + str(1
 CONF_WIRELESS_SENSORS_COUNT = "wireless_sensors_count"
 CONF_WATER_COUNTER = "water_counter"
 CONF_WATER_COUNTER_ARRAY = list(map(lambda x: CONF_WATER_COUNTER + "_" + str(1 + x), range(0, MAX_WATER_COUNTERS)))
+CONF_WIRELESS_SENSORS = "wireless_sensors"
+CONF_WIRELESS_SLICE_SIZE = "wireless_slice_size"
+CONF_LEAK = "leak"
+CONF_DISCHARGED = "discharged"
+CONF_LOST = "lost"
+CONF_SIGNAL = "signal"
 
 
 neptun_smart_ns = cg.esphome_ns.namespace("neptun_smart")
 NeptunSmartComponent = neptun_smart_ns.class_("NeptunSmartComponent", cg.Component)
-ValveZoneSwitch = neptun_smart_ns.class_("ValveZoneSwitch", switch.Switch)
-DualZoneModeSwitch = neptun_smart_ns.class_("DualZoneModeSwitch", switch.Switch)
-FloorModeSwitch = neptun_smart_ns.class_("FloorModeSwitch", switch.Switch)
-AddWirelessModeSwitch = neptun_smart_ns.class_("AddWirelessModeSwitch", switch.Switch)
-CloseOnWirelessLostSwitch = neptun_smart_ns.class_("CloseOnWirelessLostSwitch", switch.Switch)
-ChildLockSwitch = neptun_smart_ns.class_("ChildLockSwitch", switch.Switch)
+NeptunSmartSwitch = neptun_smart_ns.class_("NeptunSmartSwitch", switch.Switch)
+BinarySensorSlot = neptun_smart_ns.enum("BinarySensorSlot")
+SwitchSlot = neptun_smart_ns.enum("SwitchSlot")
+SensorSlot = neptun_smart_ns.enum("SensorSlot")
+
+# config keys to entities slots of binding table in neptun_smart.h
+BINARY_SENSOR_SLOTS = {
+    CONF_WIRELESS_SENSOR_DISCHARGED: BinarySensorSlot.BINARY_SENSOR_WIRELESS_SENSOR_DISCHARGED,
+    CONF_WIRELESS_SENSOR_LOST: BinarySensorSlot.BINARY_SENSOR_WIRELESS_SENSOR_LOST,
+}
+for idx, key in enumerate(CONF_ALERT_ZONE_ARRAY):
+    BINARY_SENSOR_SLOTS[key] = getattr(BinarySensorSlot, f"BINARY_SENSOR_ALERT_ZONE_{idx + 1}")
+for idx, key in enumerate(CONF_WIRE_LINE_LEAK_ARRAY):
+    BINARY_SENSOR_SLOTS[key] = getattr(BinarySensorSlot, f"BINARY_SENSOR_WIRE_LINE_LEAK_{idx + 1}")
+
+SWITCH_SLOTS = {
+    CONF_FLOOR_WASHING_MODE: SwitchSlot.SWITCH_FLOOR_WASHING_MODE,
+    CONF_ADD_WIRELESS_MODE: SwitchSlot.SWITCH_ADD_WIRELESS_MODE,
+    CONF_DUAL_ZONE_MODE: SwitchSlot.SWITCH_DUAL_ZONE_MODE,
+    CONF_CLOSE_ON_WIRELESS_LOST: SwitchSlot.SWITCH_CLOSE_ON_WIRELESS_LOST,
+    CONF_CHILD_LOCK: SwitchSlot.SWITCH_CHILD_LOCK,
+}
+for idx, key in enumerate(CONF_VALVE_ZONE_ARRAY):
+    SWITCH_SLOTS[key] = getattr(SwitchSlot, f"SWITCH_VALVE_ZONE_{idx + 1}")
+
+SENSOR_SLOTS = {
+    CONF_WIRELESS_SENSORS_COUNT: SensorSlot.SENSOR_WIRELESS_SENSORS_COUNT,
+}
+for idx, key in enumerate(CONF_WATER_COUNTER_ARRAY):
+    SENSOR_SLOTS[key] = getattr(SensorSlot, f"SENSOR_WATER_COUNTER_{idx + 1}")
 
 SCHEMA_ATTRS = {
     cv.GenerateID(): cv.declare_id(NeptunSmartComponent),
@@ -67,7 +102,7 @@ SCHEMA_ATTRS = {
     ),
     cv.Optional(CONF_DUAL_ZONE_MODE): cv.maybe_simple_value(
         switch.switch_schema(
-            DualZoneModeSwitch,
+            NeptunSmartSwitch,
             device_class=DEVICE_CLASS_SWITCH,
             default_restore_mode="DISABLED",
             entity_category=ENTITY_CATEGORY_CONFIG,
@@ -76,7 +111,7 @@ SCHEMA_ATTRS = {
     ),
     cv.Optional(CONF_FLOOR_WASHING_MODE): cv.maybe_simple_value(
         switch.switch_schema(
-            FloorModeSwitch,
+            NeptunSmartSwitch,
             device_class=DEVICE_CLASS_SWITCH,
             default_restore_mode="DISABLED",
             entity_category=ENTITY_CATEGORY_CONFIG,
@@ -85,7 +120,7 @@ SCHEMA_ATTRS = {
     ),
     cv.Optional(CONF_ADD_WIRELESS_MODE): cv.maybe_simple_value(
         switch.switch_schema(
-            AddWirelessModeSwitch,
+            NeptunSmartSwitch,
             device_class=DEVICE_CLASS_SWITCH,
             default_restore_mode="DISABLED",
             entity_category=ENTITY_CATEGORY_CONFIG,
@@ -94,7 +129,7 @@ SCHEMA_ATTRS = {
     ),
     cv.Optional(CONF_CLOSE_ON_WIRELESS_LOST): cv.maybe_simple_value(
         switch.switch_schema(
-            CloseOnWirelessLostSwitch,
+            NeptunSmartSwitch,
             device_class=DEVICE_CLASS_SWITCH,
             default_restore_mode="DISABLED",
             entity_category=ENTITY_CATEGORY_CONFIG,
@@ -103,7 +138,7 @@ SCHEMA_ATTRS = {
     ),
     cv.Optional(CONF_CHILD_LOCK): cv.maybe_simple_value(
         switch.switch_schema(
-            ChildLockSwitch,
+            NeptunSmartSwitch,
             device_class=DEVICE_CLASS_SWITCH,
             default_restore_mode="DISABLED",
             entity_category=ENTITY_CATEGORY_CONFIG,
@@ -141,7 +176,7 @@ for conf_id in CONF_ALERT_ZONE_ARRAY:
 for conf_id in CONF_VALVE_ZONE_ARRAY:
     SCHEMA_ATTRS[cv.Optional(conf_id)] = cv.maybe_simple_value(
         switch.switch_schema(
-            ValveZoneSwitch,
+            NeptunSmartSwitch,
             device_class=DEVICE_CLASS_SWITCH,
             default_restore_mode="DISABLED",
             icon="mdi:water-pump",
@@ -167,6 +202,61 @@ for conf_id in CONF_WATER_COUNTER_ARRAY:
         ), key=CONF_NAME,
     )
 
+WIRELESS_SENSOR_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_INDEX): cv.int_range(min=1, max=MAX_WIRELESS_SENSORS),
+        cv.Optional(CONF_LEAK): cv.maybe_simple_value(
+            binary_sensor.binary_sensor_schema(
+                device_class=DEVICE_CLASS_MOISTURE,
+            ), key=CONF_NAME,
+        ),
+        cv.Optional(CONF_DISCHARGED): cv.maybe_simple_value(
+            binary_sensor.binary_sensor_schema(
+                device_class=DEVICE_CLASS_BATTERY,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            ), key=CONF_NAME,
+        ),
+        cv.Optional(CONF_LOST): cv.maybe_simple_value(
+            binary_sensor.binary_sensor_schema(
+                device_class=DEVICE_CLASS_PROBLEM,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            ), key=CONF_NAME,
+        ),
+        cv.Optional(CONF_BATTERY_LEVEL): cv.maybe_simple_value(
+            sensor.sensor_schema(
+                unit_of_measurement=UNIT_PERCENT,
+                accuracy_decimals=0,
+                device_class=DEVICE_CLASS_BATTERY,
+                state_class=STATE_CLASS_MEASUREMENT,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            ), key=CONF_NAME,
+        ),
+        cv.Optional(CONF_SIGNAL): cv.maybe_simple_value(
+            sensor.sensor_schema(
+                icon="mdi:signal",
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_MEASUREMENT,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            ), key=CONF_NAME,
+        ),
+    }
+)
+
+
+def validate_unique_indexes(value):
+    """each wireless sensor has own status register, so it can be configured only once"""
+    indexes = [wireless[CONF_INDEX] for wireless in value]
+    for index in indexes:
+        if indexes.count(index) > 1:
+            raise cv.Invalid(f"Wireless sensor with {CONF_INDEX} {index} is configured more than once")
+    return value
+
+
+SCHEMA_ATTRS[cv.Optional(CONF_WIRELESS_SENSORS)] = cv.All(
+    cv.ensure_list(WIRELESS_SENSOR_SCHEMA), validate_unique_indexes
+)
+SCHEMA_ATTRS[cv.Optional(CONF_WIRELESS_SLICE_SIZE, default=4)] = cv.int_range(min=1, max=MAX_WIRELESS_SENSORS)
+
 CONFIG_SCHEMA = cv.Schema(SCHEMA_ATTRS).extend(cv.COMPONENT_SCHEMA).extend(cv.polling_component_schema("10s"))
 
 async def to_code(config):
@@ -177,59 +267,60 @@ async def to_code(config):
     var = cg.new_Pvariable(config[CONF_ID], modbus_tcp_component)
     await cg.register_component(var, config)
 
-    for key in [CONF_DUAL_ZONE_MODE, CONF_FLOOR_WASHING_MODE, CONF_ADD_WIRELESS_MODE, CONF_CLOSE_ON_WIRELESS_LOST, CONF_CHILD_LOCK]:
+    for key, slot in SWITCH_SLOTS.items():
         if switch_config := config.get(key):
             swt = await switch.new_switch(switch_config)
             await cg.register_parented(swt, var)
+            cg.add(swt.set_slot(slot))
             cg.add(getattr(swt, "set_has_state")(False))
-            cg.add(getattr(var, f"set_{key}_switch")(swt))
+            cg.add(var.set_switch(slot, swt))
             if sub_device:
                 cg.add(getattr(swt, "set_device_")(sub_device))
 
-    for key in [CONF_CONNECTION_STATUS, CONF_WIRELESS_SENSOR_DISCHARGED, CONF_WIRELESS_SENSOR_LOST]:
-        if sensor_config := config.get(key):
-            sens = await binary_sensor.new_binary_sensor(sensor_config)
-            cg.add(getattr(sens, "set_trigger_on_initial_state")(True))
-            cg.add(getattr(var, f"set_{key}_sensor")(sens))
-            if sub_device:
-                cg.add(getattr(sens, "set_device_")(sub_device))
+    if sensor_config := config.get(CONF_CONNECTION_STATUS):
+        sens = await binary_sensor.new_binary_sensor(sensor_config)
+        cg.add(getattr(sens, "set_trigger_on_initial_state")(True))
+        cg.add(var.set_connection_status_sensor(sens))
+        if sub_device:
+            cg.add(getattr(sens, "set_device_")(sub_device))
 
-    for key in [CONF_WIRELESS_SENSORS_COUNT]:
-        if sensor_config := config.get(key):
-            sens = await sensor.new_sensor(sensor_config)
-            cg.add(getattr(var, f"set_{key}_sensor")(sens))
-            if sub_device:
-                cg.add(getattr(sens, "set_device_")(sub_device))
-
-    for idx, key in enumerate(CONF_ALERT_ZONE_ARRAY):
-        if sensor_config := config.get(key):
-            sens = await binary_sensor.new_binary_sensor(sensor_config)
-            cg.add(getattr(sens, "set_trigger_on_initial_state")(True))
-            cg.add(getattr(var, f"set_{CONF_ALERT_ZONE}_sensor")(idx, sens))
-            if sub_device:
-                cg.add(getattr(sens, "set_device_")(sub_device))
-
-    for idx, key in enumerate(CONF_VALVE_ZONE_ARRAY):
-        if switch_config := config.get(key):
-            swt = await switch.new_switch(switch_config)
-            await cg.register_parented(swt, var)
-            cg.add(getattr(swt, "set_index")(idx))
-            cg.add(getattr(swt, "set_has_state")(False))
-            cg.add(getattr(var, f"set_{CONF_VALVE_ZONE}_switch")(idx, swt))
-            if sub_device:
-                cg.add(getattr(swt, "set_device_")(sub_device))
-
-    for idx, key in enumerate(CONF_WIRE_LINE_LEAK_ARRAY):
+    for key, slot in BINARY_SENSOR_SLOTS.items():
         if sensor_config := config.get(key):
             sens = await binary_sensor.new_binary_sensor(sensor_config)
             cg.add(getattr(sens, "set_trigger_on_initial_state")(True))
-            cg.add(getattr(var, f"set_{CONF_WIRE_LINE_LEAK}_sensor")(idx, sens))
+            cg.add(var.set_binary_sensor(slot, sens))
             if sub_device:
                 cg.add(getattr(sens, "set_device_")(sub_device))
 
-    for idx, key in enumerate(CONF_WATER_COUNTER_ARRAY):
+    for key, slot in SENSOR_SLOTS.items():
         if sensor_config := config.get(key):
             sens = await sensor.new_sensor(sensor_config)
-            cg.add(getattr(var, f"set_{CONF_WATER_COUNTER}_sensor")(idx, sens))
+            cg.add(var.set_sensor(slot, sens))
             if sub_device:
                 cg.add(getattr(sens, "set_device_")(sub_device))
+
+    cg.add(var.set_wireless_slice_size(config[CONF_WIRELESS_SLICE_SIZE]))
+    for wireless_config in config.get(CONF_WIRELESS_SENSORS, []):
+        entities = {}
+        for key in [CONF_LEAK, CONF_DISCHARGED, CONF_LOST]:
+            entities[key] = cg.nullptr
+            if sensor_config := wireless_config.get(key):
+                entities[key] = await binary_sensor.new_binary_sensor(sensor_config)
+                cg.add(getattr(entities[key], "set_trigger_on_initial_state")(True))
+        for key in [CONF_BATTERY_LEVEL, CONF_SIGNAL]:
+            entities[key] = cg.nullptr
+            if sensor_config := wireless_config.get(key):
+                entities[key] = await sensor.new_sensor(sensor_config)
+        for entity in entities.values():
+            if sub_device and entity is not cg.nullptr:
+                cg.add(getattr(entity, "set_device_")(sub_device))
+        cg.add(
+            var.add_wireless_sensor(
+                wireless_config[CONF_INDEX],
+                entities[CONF_LEAK],
+                entities[CONF_DISCHARGED],
+                entities[CONF_LOST],
+                entities[CONF_BATTERY_LEVEL],
+                entities[CONF_SIGNAL],
+            )
+        )
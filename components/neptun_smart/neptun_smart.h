@@ -7,40 +7,147 @@
 #include "esphome/components/switch/switch.h"
 #include "esphome/components/modbus_tcp/modbus_tcp.h"
 
+#include <algorithm>
 #include <vector>
 
-// #define MAX_WIRE_LINE_LEAK_SENSORS 4
-
 namespace esphome {
 namespace neptun_smart {
 
 static const char *TAG = "neptun-smart";
 
-#define MAX_ZONES 2
-#define MAX_WIRE_LINE_LEAK_SENSORS 4
-#define MAX_WATER_COUNTERS 8
-
 #define READ_CONFIG_CODE 1
-#define READ_WIRELESS_COUNT_CODE 2
-#define READ_WATER_COUNTERS_CODE 3
+#define READ_WORDS_CODE 2
 #define SET_REGISTER_0 4
+#define READ_WIRELESS_CODE 5
+
+// wireless sensors status registers 57-106: battery level (bits 0-7), leak (bit 8), discharged (bit 9),
+// lost (bit 10), signal level (bits 11-13)
+#define WIRELESS_FIRST_REGISTER 57
+#define MAX_WIRELESS_SENSORS 50
+#define WIRELESS_MAX_SPAN 16  // max registers count of one rolling slice read
+#define WIRELESS_LEAK_BIT 8
+#define WIRELESS_DISCHARGED_BIT 9
+#define WIRELESS_LOST_BIT 10
+#define WIRELESS_SIGNAL_SHIFT 11
+
+#define CONFIG_REGISTERS_COUNT 4
+#define WRITE_COMBINE_WINDOW 50  // ms to collect switches changes for one register write
+#define VALVES_MASK 0x0300       // valve zones bits 8 and 9 of register 0
+#define PUBLISH_TIME_BUDGET 10   // ms per loop for publishing states
 
 #define GET_BIT(number, bit) ((number & (1 << bit)) > 0 ? true : false)
 #define SET_BIT(number, bit, value) (value ? (number | (1 << bit)) : (number & ~(1 << bit)))
 
+enum EntityKind : uint8_t { KIND_BINARY_SENSOR, KIND_SWITCH };
+
+// entities slots (used by python code generation)
+enum BinarySensorSlot : uint8_t {
+  BINARY_SENSOR_ALERT_ZONE_1,
+  BINARY_SENSOR_ALERT_ZONE_2,
+  BINARY_SENSOR_WIRELESS_SENSOR_DISCHARGED,
+  BINARY_SENSOR_WIRELESS_SENSOR_LOST,
+  BINARY_SENSOR_WIRE_LINE_LEAK_1,
+  BINARY_SENSOR_WIRE_LINE_LEAK_2,
+  BINARY_SENSOR_WIRE_LINE_LEAK_3,
+  BINARY_SENSOR_WIRE_LINE_LEAK_4,
+  BINARY_SENSORS_COUNT
+};
+
+enum SwitchSlot : uint8_t {
+  SWITCH_FLOOR_WASHING_MODE,
+  SWITCH_ADD_WIRELESS_MODE,
+  SWITCH_VALVE_ZONE_1,
+  SWITCH_VALVE_ZONE_2,
+  SWITCH_DUAL_ZONE_MODE,
+  SWITCH_CLOSE_ON_WIRELESS_LOST,
+  SWITCH_CHILD_LOCK,
+  SWITCHES_COUNT
+};
+
+enum SensorSlot : uint8_t {
+  SENSOR_WIRELESS_SENSORS_COUNT,
+  SENSOR_WATER_COUNTER_1,
+  SENSOR_WATER_COUNTER_2,
+  SENSOR_WATER_COUNTER_3,
+  SENSOR_WATER_COUNTER_4,
+  SENSOR_WATER_COUNTER_5,
+  SENSOR_WATER_COUNTER_6,
+  SENSOR_WATER_COUNTER_7,
+  SENSOR_WATER_COUNTER_8,
+  SENSORS_COUNT
+};
+
+// bit of one of config and status registers (0-3) bound to binary sensor or switch
+typedef struct {
+  uint8_t reg, bit;
+  EntityKind kind;
+  uint8_t slot;
+} BitBinding;
+
+// one register or two registers (big-endian 32 bit value) bound to sensor
+typedef struct {
+  uint16_t reg;
+  uint8_t words;
+  uint8_t slot;
+  float scale;
+} WordBinding;
+
+static constexpr BitBinding BIT_BINDINGS[] = {
+    {0, 0, KIND_SWITCH, SWITCH_FLOOR_WASHING_MODE},
+    {0, 1, KIND_BINARY_SENSOR, BINARY_SENSOR_ALERT_ZONE_1},
+    {0, 2, KIND_BINARY_SENSOR, BINARY_SENSOR_ALERT_ZONE_2},
+    {0, 3, KIND_BINARY_SENSOR, BINARY_SENSOR_WIRELESS_SENSOR_DISCHARGED},
+    {0, 4, KIND_BINARY_SENSOR, BINARY_SENSOR_WIRELESS_SENSOR_LOST},
+    {0, 7, KIND_SWITCH, SWITCH_ADD_WIRELESS_MODE},
+    {0, 8, KIND_SWITCH, SWITCH_VALVE_ZONE_1},
+    {0, 9, KIND_SWITCH, SWITCH_VALVE_ZONE_2},
+    {0, 10, KIND_SWITCH, SWITCH_DUAL_ZONE_MODE},
+    {0, 11, KIND_SWITCH, SWITCH_CLOSE_ON_WIRELESS_LOST},
+    {0, 12, KIND_SWITCH, SWITCH_CHILD_LOCK},
+    {3, 0, KIND_BINARY_SENSOR, BINARY_SENSOR_WIRE_LINE_LEAK_1},
+    {3, 1, KIND_BINARY_SENSOR, BINARY_SENSOR_WIRE_LINE_LEAK_2},
+    {3, 2, KIND_BINARY_SENSOR, BINARY_SENSOR_WIRE_LINE_LEAK_3},
+    {3, 3, KIND_BINARY_SENSOR, BINARY_SENSOR_WIRE_LINE_LEAK_4},
+};
+static constexpr uint8_t BIT_BINDINGS_COUNT = sizeof(BIT_BINDINGS) / sizeof(BitBinding);
+static_assert(BIT_BINDINGS_COUNT <= 32, "published bits are kept in uint32_t");
+static constexpr uint32_t ALL_BITS = BIT_BINDINGS_COUNT == 32 ? 0xFFFFFFFF : ((uint32_t) 1 << BIT_BINDINGS_COUNT) - 1;
+
+// sorted by register
+static constexpr WordBinding WORD_BINDINGS[] = {
+    {6, 1, SENSOR_WIRELESS_SENSORS_COUNT, 1.0f},
+    {107, 2, SENSOR_WATER_COUNTER_1, 0.001f},
+    {109, 2, SENSOR_WATER_COUNTER_2, 0.001f},
+    {111, 2, SENSOR_WATER_COUNTER_3, 0.001f},
+    {113, 2, SENSOR_WATER_COUNTER_4, 0.001f},
+    {115, 2, SENSOR_WATER_COUNTER_5, 0.001f},
+    {117, 2, SENSOR_WATER_COUNTER_6, 0.001f},
+    {119, 2, SENSOR_WATER_COUNTER_7, 0.001f},
+    {121, 2, SENSOR_WATER_COUNTER_8, 0.001f},
+};
+static constexpr uint8_t WORD_BINDINGS_COUNT = sizeof(WORD_BINDINGS) / sizeof(WordBinding);
+static_assert(WORD_BINDINGS_COUNT <= 32, "changed words are kept in uint32_t");
+
+// radio sensor of Neptun ProW+ and its status register
+typedef struct {
+  uint8_t index;  // 1-50
+  binary_sensor::BinarySensor *leak, *discharged, *lost;
+  sensor::Sensor *battery, *signal;
+  uint16_t status;
+  bool received, changed;
+} WirelessSensor;
+
+// mask of register 0 bits written by switch
+static constexpr uint16_t switch_mask(uint8_t slot) {
+  for (auto &binding : BIT_BINDINGS)
+    if (binding.kind == KIND_SWITCH && binding.slot == slot && binding.reg == 0)
+      return 1 << binding.bit;
+  return 0;
+}
+
 class NeptunSmartComponent : public PollingComponent {
  public:
-  NeptunSmartComponent(modbus_tcp::ModbusTcpComponent *modbus_tcp) : modbus_tcp_(modbus_tcp) {
-    uint8_t i;
-    for (i = 0; i < MAX_ZONES; i++) {
-      alert_zone_sensor_[i] = nullptr;
-      valve_zone_switch_[i] = nullptr;
-    }
-    for (i = 0; i < MAX_WIRE_LINE_LEAK_SENSORS; i++)
-      wire_line_leak_sensor_[i] = nullptr;
-    for (i = 0; i < MAX_WATER_COUNTERS; i++)
-      water_counter_sensor_[i] = nullptr;
-  }
+  NeptunSmartComponent(modbus_tcp::ModbusTcpComponent *modbus_tcp) : modbus_tcp_(modbus_tcp) {}
 
   float get_setup_priority() const override { return setup_priority::AFTER_WIFI; };
 
@@ -48,54 +155,47 @@ class NeptunSmartComponent : public PollingComponent {
     // set Neptun Smart default MODBUS-address, if it was not set on ModbusTcpComponent
     if (modbus_tcp_->get_address() == 0)
       modbus_tcp_->set_address(240);
-    // on connect request all configs and statuses
+    // registers blocks are read on connect and every update interval; near blocks are read with one request
+    modbus_tcp_->add_register_block(READ_CONFIG_CODE, 0, CONFIG_REGISTERS_COUNT, get_update_interval());
+    add_word_blocks();
     modbus_tcp_->set_on_connect([this]() {
-      next_update_time_ = 1;
       if (connection_status_sensor_)
         connection_status_sensor_->publish_state(true);
     });
-    // on disconnect pause regular updating
+    // on disconnect forbid writing until config and status will be received again
     modbus_tcp_->set_on_disconnect([this]() {
       can_write_ = false;
-      next_update_time_ = 0;
+      write_in_progress_ = false;
       if (connection_status_sensor_)
         connection_status_sensor_->publish_state(false);
     });
+    // write was not confirmed: new state will be received with next config read
+    modbus_tcp_->set_on_error([this](uint8_t code, uint16_t error) {
+      if (code == SET_REGISTER_0) {
+        ESP_LOGW(TAG, "Failed to write register 0 (error 0x%02x)", error);
+        write_in_progress_ = false;
+        modbus_tcp_->request_register_blocks();
+      }
+    });
     // process received data on register response
     modbus_tcp_->set_on_register_response([this](uint8_t code, uint8_t *data, uint16_t register_count) {
       ESP_LOGV(TAG, "Received %d bytes for command 0x%02x", register_count, code);
       switch (code) {
         case READ_CONFIG_CODE: {
-          if (register_count != 4) {
+          if (register_count != CONFIG_REGISTERS_COUNT) {
             ESP_LOGW(TAG, "Wrong registers count (%d) for config and status response", register_count);
           } else {
-            for (uint8_t i = 0; i < 4; i++)
+            for (uint8_t i = 0; i < CONFIG_REGISTERS_COUNT; i++)
               last_config_and_status_[i] = (uint16_t) data[2 * i] << 8 | data[2 * i + 1];
-            state_config_and_status_ = 1;
+            // publish all states after first response, later only changed ones
+            if (!config_received_) {
+              config_received_ = true;
+              published_bits_ = ~current_bits() & ALL_BITS;
+            }
             can_write_ = true;
-          }
-        } break;
-
-        case READ_WIRELESS_COUNT_CODE: {
-          if (register_count != 1) {
-            ESP_LOGW(TAG, "Wrong registers count (%d) for wireless count response", register_count);
-          } else if (wireless_sensors_count_sensor_) {
-            float new_state = (float) ((uint16_t) data[0] << 8 | data[1]);
-            ESP_LOGV(TAG, "Got READ_WIRELESS_COUNT_CODE response 0x%04x", new_state);
-            if (!wireless_sensors_count_sensor_->has_state() ||
-                new_state != wireless_sensors_count_sensor_->get_state())
-              wireless_sensors_count_sensor_->publish_state(new_state);
-          }
-        } break;
-
-        case READ_WATER_COUNTERS_CODE: {
-          if (register_count != 16) {
-            ESP_LOGW(TAG, "Wrong registers count (%d) for water counters response", register_count);
-          } else {
-            for (uint8_t i = 0; i < MAX_WATER_COUNTERS; i++)
-              last_water_counters_[i] = (uint32_t) data[4 * i] << 24 | (uint32_t) data[4 * i + 1] << 16 |
-                                        (uint32_t) data[4 * i + 2] << 8 | data[4 * i + 3];
-            state_water_counters_ = 1;
+            // response to read queued after write contains its result
+            write_in_progress_ = false;
+            flush_writes();
           }
         } break;
 
@@ -103,9 +203,11 @@ class NeptunSmartComponent : public PollingComponent {
           if (register_count != 1) {
             ESP_LOGW(TAG, "Wrong registers count (%d) for write response with code %d", register_count, code);
           } else {
+            // echoed value is validated by ModbusTcpComponent, so it is new register value
             last_config_and_status_[0] = (uint16_t) data[0] << 8 | data[1];
             ESP_LOGV(TAG, "Got SET_REGISTER_0 response 0x%04x", last_config_and_status_[0]);
-            state_config_and_status_ = 1;
+            write_in_progress_ = false;
+            flush_writes();
           }
         } break;
 
@@ -115,236 +217,286 @@ class NeptunSmartComponent : public PollingComponent {
     });
   };
 
+  // publish only states which differ from published ones, while time budget of loop is not exceeded
   void loop() override {
-    unsigned long current_time;
-    if (next_update_time_ > 0 && next_update_time_ < (current_time = millis())) {
-      ESP_LOGV(TAG, "Update information");
-      next_update_time_ = current_time + get_update_interval();
-      read_config_and_status();
-      if (wireless_sensors_count_sensor_)
-        read_wireless_sensors_count();
-      if (has_water_counters_)
-        read_water_counters();
-      return;
+    uint32_t start_time = millis();
+    uint32_t bits = current_bits();
+    uint32_t changed = (bits ^ published_bits_) & ALL_BITS;
+    while (changed != 0) {
+      uint8_t idx = __builtin_ctz(changed);
+      publish_bit(BIT_BINDINGS[idx], (bits >> idx) & 1);
+      published_bits_ ^= (uint32_t) 1 << idx;
+      changed &= changed - 1;
+      if (millis() - start_time >= PUBLISH_TIME_BUDGET)
+        return;
     }
-    if (state_config_and_status_ > 0) {
-      uint16_t bit = (state_config_and_status_++) - 1;
-      if (bit > 32)
-        state_config_and_status_ = 0;
-      else if (bit == 0 && floor_washing_mode_switch_)
-        floor_washing_mode_switch_->publish_state(GET_BIT(last_config_and_status_[0], 0));
-      else if (bit >= 1 && bit < 1 + MAX_ZONES && alert_zone_sensor_[bit - 1])
-        alert_zone_sensor_[bit - 1]->publish_state(GET_BIT(last_config_and_status_[0], bit));
-      else if (bit == 3 && wireless_sensor_discharged_sensor_)
-        wireless_sensor_discharged_sensor_->publish_state(GET_BIT(last_config_and_status_[0], 3));
-      else if (bit == 4 && wireless_sensor_lost_sensor_)
-        wireless_sensor_lost_sensor_->publish_state(GET_BIT(last_config_and_status_[0], 4));
-      else if (bit == 7 && add_wireless_mode_switch_)
-        add_wireless_mode_switch_->publish_state(GET_BIT(last_config_and_status_[0], 7));
-      else if (bit >= 8 && bit < 8 + MAX_ZONES && valve_zone_switch_[bit - 8])
-        valve_zone_switch_[bit - 8]->publish_state(GET_BIT(last_config_and_status_[0], bit));
-      else if (bit == 10 && dual_zone_mode_switch_) {
-        bool state = GET_BIT(last_config_and_status_[0], 10);
-        dual_zone_mode_switch_->publish_state(state);
-        // show/hide zone2 controls; need esp RESTART after changing
-        bool internal = !state;
-        if (alert_zone_sensor_[1])
-          alert_zone_sensor_[1]->set_internal(internal);
-        if (valve_zone_switch_[1])
-          valve_zone_switch_[1]->set_internal(internal);
-      } else if (bit == 11 && close_on_wireless_lost_switch_)
-        close_on_wireless_lost_switch_->publish_state(GET_BIT(last_config_and_status_[0], 11));
-      else if (bit == 12 && child_lock_switch_)
-        child_lock_switch_->publish_state(GET_BIT(last_config_and_status_[0], 12));
-      else if (bit >= 24 && bit < 24 + MAX_WIRE_LINE_LEAK_SENSORS && wire_line_leak_sensor_[bit - 24]) {
-        wire_line_leak_sensor_[bit - 24]->publish_state(GET_BIT(last_config_and_status_[3], (bit - 24)));
-      }
+    while (changed_words_ != 0) {
+      uint8_t idx = __builtin_ctz(changed_words_);
+      auto &binding = WORD_BINDINGS[idx];
+      sensors_[binding.slot]->publish_state((float) last_words_[idx] * binding.scale);
+      changed_words_ &= changed_words_ - 1;
+      if (millis() - start_time >= PUBLISH_TIME_BUDGET)
+        return;
+    }
+  };
+
+  // every update interval read slice of wireless sensors status registers: changed sensors are read first,
+  // remaining budget is used for rolling read from cursor, so all sensors are refreshed within
+  // ceil(count / slice size) cycles
+  void update() override {
+    if (wireless_sensors_.empty() || !can_write_)
       return;
+    uint8_t budget = wireless_slice_size_;
+    for (auto &wireless : wireless_sensors_) {
+      if (wireless.changed && budget > 0) {
+        read_wireless_sensors(wireless.index, wireless.index);
+        wireless.changed = false;
+        budget--;
+      }
     }
-    if (state_water_counters_ > 0) {
-      uint16_t idx = (state_water_counters_++) - 1;
-      if (idx > MAX_WATER_COUNTERS)
-        state_water_counters_ = 0;
-      else if (idx < MAX_WATER_COUNTERS && water_counter_sensor_[idx]) {
-        float new_state = (float) last_water_counters_[idx] / 1000.0;
-        if (!water_counter_sensor_[idx]->has_state() || new_state != water_counter_sensor_[idx]->get_state())
-          water_counter_sensor_[idx]->publish_state(new_state);
+    // rolling slice: neighbouring configured sensors are read with one request
+    uint8_t rolled = 0;
+    while (budget > 0 && rolled < wireless_sensors_.size()) {
+      if (wireless_cursor_ >= wireless_sensors_.size())
+        wireless_cursor_ = 0;
+      uint8_t first = wireless_sensors_[wireless_cursor_].index, last = first;
+      uint8_t count = 0;
+      while (count < budget && rolled + count < wireless_sensors_.size() &&
+             wireless_cursor_ < wireless_sensors_.size() &&
+             wireless_sensors_[wireless_cursor_].index - first < WIRELESS_MAX_SPAN) {
+        last = wireless_sensors_[wireless_cursor_++].index;
+        count++;
       }
-      return;
+      read_wireless_sensors(first, last);
+      budget -= count;
+      rolled += count;
     }
   };
 
-  void update() override {};
-
   void dump_config() override {
-    uint8_t i;
     ESP_LOGCONFIG(TAG, "Neptun Smart");
     if (connection_status_sensor_)
       LOG_BINARY_SENSOR("  ", "Connection Status Sensor", connection_status_sensor_);
-    if (dual_zone_mode_switch_)
-      LOG_SWITCH("  ", "Dual Zone Mode Switch:", dual_zone_mode_switch_);
-    for (i = 0; i < MAX_ZONES; i++)
-      if (alert_zone_sensor_[i])
-        LOG_BINARY_SENSOR("  ", "Alert Zone Sensor", alert_zone_sensor_[i]);
-    for (i = 0; i < MAX_ZONES; i++)
-      if (valve_zone_switch_[i])
-        LOG_SWITCH("  ", "Valve Zone Switch", valve_zone_switch_[i]);
-    if (floor_washing_mode_switch_)
-      LOG_SWITCH("  ", "Floor Washing Mode Switch:", floor_washing_mode_switch_);
-    if (add_wireless_mode_switch_)
-      LOG_SWITCH("  ", "Adding Wireless Sensor Switch:", add_wireless_mode_switch_);
-    if (close_on_wireless_lost_switch_)
-      LOG_SWITCH("  ", "Close On Wireless Sensor Lost Switch:", close_on_wireless_lost_switch_);
-    if (child_lock_switch_)
-      LOG_SWITCH("  ", "Child Lock Switch:", child_lock_switch_);
-    if (wireless_sensor_discharged_sensor_)
-      LOG_BINARY_SENSOR("  ", "Wireless Sensor Discharged Sensor", wireless_sensor_discharged_sensor_);
-    if (wireless_sensor_lost_sensor_)
-      LOG_BINARY_SENSOR("  ", "Wireless Sensor Lost Sensor", wireless_sensor_lost_sensor_);
-    if (wireless_sensors_count_sensor_)
-      LOG_SENSOR("  ", "Wireless Sensors Count Sensor:", wireless_sensors_count_sensor_);
-    for (i = 0; i < MAX_WIRE_LINE_LEAK_SENSORS; i++)
-      if (wire_line_leak_sensor_[i])
-        LOG_BINARY_SENSOR("  ", "Wire Line Leak Sensor", wire_line_leak_sensor_[i]);
-    for (i = 0; i < MAX_WATER_COUNTERS; i++)
-      if (water_counter_sensor_[i])
-        LOG_SENSOR("  ", "Water Counter Sensor", water_counter_sensor_[i]);
+    for (auto &binding : BIT_BINDINGS) {
+      if (binding.kind == KIND_SWITCH && switches_[binding.slot])
+        LOG_SWITCH("  ", "Switch", switches_[binding.slot]);
+      else if (binding.kind == KIND_BINARY_SENSOR && binary_sensors_[binding.slot])
+        LOG_BINARY_SENSOR("  ", "Binary Sensor", binary_sensors_[binding.slot]);
+    }
+    for (auto &binding : WORD_BINDINGS)
+      if (sensors_[binding.slot])
+        LOG_SENSOR("  ", "Sensor", sensors_[binding.slot]);
+    if (!wireless_sensors_.empty())
+      ESP_LOGCONFIG(TAG, "  Wireless Sensors: %d, slice size %d", wireless_sensors_.size(), wireless_slice_size_);
+    for (auto &wireless : wireless_sensors_) {
+      ESP_LOGCONFIG(TAG, "  Wireless Sensor %d", wireless.index);
+      LOG_BINARY_SENSOR("    ", "Leak", wireless.leak);
+      LOG_BINARY_SENSOR("    ", "Discharged", wireless.discharged);
+      LOG_BINARY_SENSOR("    ", "Lost", wireless.lost);
+      LOG_SENSOR("    ", "Battery", wireless.battery);
+      LOG_SENSOR("    ", "Signal", wireless.signal);
+    }
   };
 
   bool can_write() { return can_write_; }
 
   void set_connection_status_sensor(binary_sensor::BinarySensor *sensor) { connection_status_sensor_ = sensor; }
-  void set_dual_zone_mode_switch(switch_::Switch *swt) { dual_zone_mode_switch_ = swt; }
-  void set_alert_zone_sensor(uint8_t index, binary_sensor::BinarySensor *sensor) {
-    if (index < MAX_ZONES)
-      alert_zone_sensor_[index] = sensor;
+  void set_binary_sensor(uint8_t slot, binary_sensor::BinarySensor *sensor) {
+    if (slot < BINARY_SENSORS_COUNT)
+      binary_sensors_[slot] = sensor;
   }
-  void set_valve_zone_switch(uint8_t index, switch_::Switch *swt) {
-    if (index < MAX_ZONES)
-      valve_zone_switch_[index] = swt;
+  void set_switch(uint8_t slot, switch_::Switch *swt) {
+    if (slot < SWITCHES_COUNT)
+      switches_[slot] = swt;
   }
-  void set_wireless_sensor_lost_sensor(binary_sensor::BinarySensor *sensor) { wireless_sensor_lost_sensor_ = sensor; }
-  void set_floor_washing_mode_switch(switch_::Switch *swt) { floor_washing_mode_switch_ = swt; }
-  void set_add_wireless_mode_switch(switch_::Switch *swt) { add_wireless_mode_switch_ = swt; }
-  void set_close_on_wireless_lost_switch(switch_::Switch *swt) { close_on_wireless_lost_switch_ = swt; }
-  void set_child_lock_switch(switch_::Switch *swt) { child_lock_switch_ = swt; }
-  void set_wireless_sensor_discharged_sensor(binary_sensor::BinarySensor *sensor) {
-    wireless_sensor_discharged_sensor_ = sensor;
+  void set_sensor(uint8_t slot, sensor::Sensor *sensor) {
+    if (slot < SENSORS_COUNT)
+      sensors_[slot] = sensor;
   }
-  void set_wireless_sensors_count_sensor(sensor::Sensor *sensor) { wireless_sensors_count_sensor_ = sensor; }
 
-  void set_wire_line_leak_sensor(uint8_t index, binary_sensor::BinarySensor *sensor) {
-    if (index < MAX_WIRE_LINE_LEAK_SENSORS) {
-      wire_line_leak_sensor_[index] = sensor;
-      has_wire_line_leak_sensor_ = true;
-    }
+  void set_wireless_slice_size(uint8_t size) { wireless_slice_size_ = size > 0 ? size : 1; }
+  void add_wireless_sensor(uint8_t index, binary_sensor::BinarySensor *leak, binary_sensor::BinarySensor *discharged,
+                           binary_sensor::BinarySensor *lost, sensor::Sensor *battery, sensor::Sensor *signal) {
+    if (index < 1 || index > MAX_WIRELESS_SENSORS)
+      return;
+    WirelessSensor wireless{index, leak, discharged, lost, battery, signal, 0, false, false};
+    auto it = std::lower_bound(wireless_sensors_.begin(), wireless_sensors_.end(), index,
+                               [](const WirelessSensor &w, uint8_t i) { return w.index < i; });
+    wireless_sensors_.insert(it, wireless);
   }
 
-  void set_water_counter_sensor(uint8_t index, sensor::Sensor *sensor) {
-    if (index < MAX_WATER_COUNTERS) {
-      water_counter_sensor_[index] = sensor;
-      has_water_counters_ = true;
-    }
+  void write_switch(uint8_t slot, bool state) {
+    ESP_LOGD(TAG, "Setting switch %d to: %s", slot, state ? "on" : "off");
+    uint16_t mask = switch_mask(slot);
+    // for dual-zone mode change only one valve bit (8 or 9); for non-dual change both valve bits (8 and 9)
+    if ((mask & VALVES_MASK) != 0 && !GET_BIT(config_value(), 10))
+      mask = VALVES_MASK;
+    if (mask != 0)
+      write_bits(mask, state);
   }
 
-  void read_config_and_status() { modbus_tcp_->read_registers(READ_CONFIG_CODE, 0, 4); }
-  void read_wireless_sensors_count() { modbus_tcp_->read_registers(READ_WIRELESS_COUNT_CODE, 6, 1); }
-  void read_water_counters() { modbus_tcp_->read_registers(READ_WATER_COUNTERS_CODE, 107, 16); }
+ protected:
+  // register value with not written yet changes
+  uint16_t register_value(uint8_t reg) { return reg == 0 ? config_value() : last_config_and_status_[reg]; }
+
+  // states of all bit bindings: bit N is state of BIT_BINDINGS[N]
+  uint32_t current_bits() {
+    if (!config_received_)
+      return published_bits_;
+    uint32_t bits = 0;
+    for (uint8_t i = 0; i < BIT_BINDINGS_COUNT; i++)
+      if (GET_BIT(register_value(BIT_BINDINGS[i].reg), BIT_BINDINGS[i].bit))
+        bits |= (uint32_t) 1 << i;
+    return bits;
+  }
 
-  void set_floor_washing_mode(bool state) {
-    ESP_LOGD(TAG, "Setting floor washing mode to: %s", state ? "on" : "off");
-    modbus_tcp_->write_register(SET_REGISTER_0, 0, SET_BIT(last_config_and_status_[0], 0, state));
+  void publish_bit(const BitBinding &binding, bool state) {
+    if (binding.kind == KIND_BINARY_SENSOR && binary_sensors_[binding.slot]) {
+      binary_sensors_[binding.slot]->publish_state(state);
+    } else if (binding.kind == KIND_SWITCH && switches_[binding.slot]) {
+      switches_[binding.slot]->publish_state(state);
+      if (binding.slot == SWITCH_DUAL_ZONE_MODE) {
+        // show/hide zone2 controls; need esp RESTART after changing
+        bool internal = !state;
+        if (binary_sensors_[BINARY_SENSOR_ALERT_ZONE_2])
+          binary_sensors_[BINARY_SENSOR_ALERT_ZONE_2]->set_internal(internal);
+        if (switches_[SWITCH_VALVE_ZONE_2])
+          switches_[SWITCH_VALVE_ZONE_2]->set_internal(internal);
+      }
+    }
   }
 
-  void set_add_wireless_mode(bool state) {
-    ESP_LOGD(TAG, "Setting add wireless sensor mode to: %s", state ? "on" : "off");
-    modbus_tcp_->write_register(SET_REGISTER_0, 0, SET_BIT(last_config_and_status_[0], 7, state));
+  // read registers of configured word bindings; adjacent bindings are read with one block
+  void add_word_blocks() {
+    int first = -1, last = -1;
+    for (uint8_t i = 0; i <= WORD_BINDINGS_COUNT; i++) {
+      bool end = i == WORD_BINDINGS_COUNT;
+      if (!end && !sensors_[WORD_BINDINGS[i].slot])
+        continue;
+      if (!end && first >= 0 && WORD_BINDINGS[i].reg == last) {
+        last += WORD_BINDINGS[i].words;
+        continue;
+      }
+      if (first >= 0) {
+        uint16_t first_register = first;
+        modbus_tcp_->add_register_block(READ_WORDS_CODE, first_register, last - first, get_update_interval(),
+                                        [this, first_register](uint8_t code, uint8_t *data, uint16_t count) {
+                                          decode_words(first_register, data, count);
+                                        });
+      }
+      if (!end) {
+        first = WORD_BINDINGS[i].reg;
+        last = first + WORD_BINDINGS[i].words;
+      }
+    }
   }
 
-  void set_valve_zone(uint8_t index, bool state) {
-    if (index < MAX_ZONES) {
-      ESP_LOGD(TAG, "Setting valve zone %d to: %s", index + 1, state ? "on" : "off");
-      // for dual-zone mode change only one valve bit (8 or 9); for non-dual change both valve bits (8 and 9)
-      uint16_t new_value = GET_BIT(last_config_and_status_[0], 10)
-                               ? SET_BIT(last_config_and_status_[0], (8 + index), state)
-                               : SET_BIT(SET_BIT(last_config_and_status_[0], 8, state), 9, state);
-      modbus_tcp_->write_register(SET_REGISTER_0, 0, new_value);
+  void decode_words(uint16_t first_register, uint8_t *data, uint16_t register_count) {
+    for (uint8_t i = 0; i < WORD_BINDINGS_COUNT; i++) {
+      auto &binding = WORD_BINDINGS[i];
+      if (binding.reg < first_register || binding.reg + binding.words > first_register + register_count)
+        continue;
+      uint8_t *word = data + 2 * (binding.reg - first_register);
+      uint32_t value = 0;
+      for (uint8_t j = 0; j < 2 * binding.words; j++)
+        value = value << 8 | word[j];
+      auto *sensor = sensors_[binding.slot];
+      if (sensor && (value != last_words_[i] || !sensor->has_state()))
+        changed_words_ |= (uint32_t) 1 << i;
+      last_words_[i] = value;
     }
   }
 
-  void set_dual_zone_mode(bool state) {
-    ESP_LOGD(TAG, "Setting dual zone mode to: %s", state ? "on" : "off");
-    modbus_tcp_->write_register(SET_REGISTER_0, 0, SET_BIT(last_config_and_status_[0], 10, state));
+  void read_wireless_sensors(uint8_t first, uint8_t last) {
+    ESP_LOGV(TAG, "Reading wireless sensors %d-%d", first, last);
+    modbus_tcp_->read_registers(
+        READ_WIRELESS_CODE, WIRELESS_FIRST_REGISTER + first - 1, last - first + 1, nullptr,
+        [this, first](uint8_t code, uint8_t *data, uint16_t count) { decode_wireless_sensors(first, data, count); });
   }
 
-  void set_close_on_wireless_lost(bool state) {
-    ESP_LOGD(TAG, "Setting close on wireless sensor lost to: %s", state ? "on" : "off");
-    modbus_tcp_->write_register(SET_REGISTER_0, 0, SET_BIT(last_config_and_status_[0], 11, state));
+  void decode_wireless_sensors(uint8_t first, uint8_t *data, uint16_t register_count) {
+    for (auto &wireless : wireless_sensors_) {
+      if (wireless.index < first || wireless.index >= first + register_count)
+        continue;
+      uint8_t *word = data + 2 * (wireless.index - first);
+      uint16_t status = (uint16_t) word[0] << 8 | word[1];
+      if (wireless.received && status == wireless.status)
+        continue;
+      // changed sensor is read again with next slice, until its state is stable
+      wireless.changed = wireless.received;
+      wireless.received = true;
+      wireless.status = status;
+      ESP_LOGD(TAG, "Wireless sensor %d status 0x%04x", wireless.index, status);
+      if (wireless.leak)
+        wireless.leak->publish_state(GET_BIT(status, WIRELESS_LEAK_BIT));
+      if (wireless.discharged)
+        wireless.discharged->publish_state(GET_BIT(status, WIRELESS_DISCHARGED_BIT));
+      if (wireless.lost)
+        wireless.lost->publish_state(GET_BIT(status, WIRELESS_LOST_BIT));
+      if (wireless.battery)
+        wireless.battery->publish_state(status & 0xFF);
+      if (wireless.signal)
+        wireless.signal->publish_state((status >> WIRELESS_SIGNAL_SHIFT) & 0x07);
+    }
   }
 
-  void set_child_lock(bool state) {
-    ESP_LOGD(TAG, "Setting child lock to: %s", state ? "on" : "off");
-    modbus_tcp_->write_register(SET_REGISTER_0, 0, SET_BIT(last_config_and_status_[0], 12, state));
+  // register 0 value with not written yet changes
+  uint16_t config_value() { return (last_config_and_status_[0] & ~pending_mask_) | (pending_value_ & pending_mask_); }
+
+  // write-combining: changes of several switches during short window are written with one request
+  void write_bits(uint16_t mask, bool state) {
+    bool scheduled = pending_mask_ != 0;
+    pending_mask_ |= mask;
+    pending_value_ = state ? pending_value_ | mask : pending_value_ & ~mask;
+    if (!scheduled)
+      set_timeout("write_register_0", WRITE_COMBINE_WINDOW, [this]() { flush_writes(); });
+  }
+
+  // apply pending changes to the latest known register value; only one write is in flight at a time
+  void flush_writes() {
+    if (pending_mask_ == 0 || write_in_progress_ || !can_write_)
+      return;
+    uint16_t new_value = config_value();
+    ESP_LOGD(TAG, "Writing register 0: 0x%04x (changed bits 0x%04x)", new_value, pending_mask_);
+    // valve command must not be lost if module reboots before it is sent
+    if (modbus_tcp_->write_register(SET_REGISTER_0, 0, new_value, (pending_mask_ & VALVES_MASK) != 0)) {
+      write_in_progress_ = true;
+      pending_mask_ = pending_value_ = 0;
+      // optimistic state until echo, so next changes are applied to it
+      last_config_and_status_[0] = new_value;
+    }
   }
 
- protected:
   modbus_tcp::ModbusTcpComponent *modbus_tcp_;
-  uint16_t state_config_and_status_{0}, state_water_counters_{0};
-  uint16_t last_config_and_status_[4]{0, 0, 0, 0};
-  uint32_t last_water_counters_[MAX_WATER_COUNTERS];
-  binary_sensor::BinarySensor *alert_zone_sensor_[MAX_ZONES];
-  switch_::Switch *valve_zone_switch_[MAX_ZONES];
-  switch_::Switch *zone_1_switch_{nullptr}, *zone_2_switch_{nullptr}, *dual_zone_mode_switch_{nullptr},
-      *floor_washing_mode_switch_{nullptr}, *add_wireless_mode_switch_{nullptr},
-      *close_on_wireless_lost_switch_{nullptr}, *child_lock_switch_{nullptr};
-  binary_sensor::BinarySensor *connection_status_sensor_{nullptr}, *wireless_sensor_discharged_sensor_{nullptr},
-      *wireless_sensor_lost_sensor_{nullptr};
-  sensor::Sensor *wireless_sensors_count_sensor_{nullptr};
-  binary_sensor::BinarySensor *wire_line_leak_sensor_[MAX_WIRE_LINE_LEAK_SENSORS];
-  sensor::Sensor *water_counter_sensor_[MAX_WATER_COUNTERS];
-  bool has_wire_line_leak_sensor_{false}, has_water_counters_{false}, can_write_{false};
-  unsigned long next_update_time_{0};
+  uint16_t last_config_and_status_[CONFIG_REGISTERS_COUNT]{0, 0, 0, 0};
+  uint32_t last_words_[WORD_BINDINGS_COUNT]{};
+  uint32_t published_bits_{0}, changed_words_{0};
+  binary_sensor::BinarySensor *connection_status_sensor_{nullptr};
+  binary_sensor::BinarySensor *binary_sensors_[BINARY_SENSORS_COUNT]{};
+  switch_::Switch *switches_[SWITCHES_COUNT]{};
+  sensor::Sensor *sensors_[SENSORS_COUNT]{};
+  std::vector<WirelessSensor> wireless_sensors_;
+  uint8_t wireless_slice_size_{4}, wireless_cursor_{0};
+  bool config_received_{false}, can_write_{false}, write_in_progress_{false};
+  uint16_t pending_mask_{0}, pending_value_{0};
 };
 
-class AbstractApplySwitch : public switch_::Switch, public Parented<NeptunSmartComponent> {
+// switch bound to bit of register 0 by slot
+class NeptunSmartSwitch : public switch_::Switch, public Parented<NeptunSmartComponent> {
+ public:
+  void set_slot(uint8_t slot) { slot_ = slot; }
+
  protected:
-  virtual void apply_state(bool state) = 0;
   void write_state(bool state) override {
     if (parent_->can_write()) {
       publish_state(state);
-      apply_state(state);
+      parent_->write_switch(slot_, state);
     } else {
       ESP_LOGW(TAG, "Device not connected or config was not received yet!");
     }
   }
-};
-
-class ValveZoneSwitch : public AbstractApplySwitch {
-  void apply_state(bool state) override { parent_->set_valve_zone(index_, state); }
-  uint8_t index_;
-
- public:
-  void set_index(uint8_t index) { index_ = index; }
-};
-
-class DualZoneModeSwitch : public AbstractApplySwitch {
-  void apply_state(bool state) override { parent_->set_dual_zone_mode(state); }
-};
-
-class FloorModeSwitch : public AbstractApplySwitch {
-  void apply_state(bool state) override { parent_->set_floor_washing_mode(state); }
-};
-
-class AddWirelessModeSwitch : public AbstractApplySwitch {
-  void apply_state(bool state) override { parent_->set_add_wireless_mode(state); }
-};
-
-class CloseOnWirelessLostSwitch : public AbstractApplySwitch {
-  void apply_state(bool state) override { parent_->set_close_on_wireless_lost(state); }
-};
 
-class ChildLockSwitch : public AbstractApplySwitch {
-  void apply_state(bool state) override { parent_->set_child_lock(state); }
+  uint8_t slot_{0};
 };
 
 }  // namespace neptun_smart
@@ -9,6 +9,7 @@ from esphome.const import (
     CONF_UART_ID,
     CONF_ADDRESS,
     CONF_POWER,
+    CONF_TRIGGER_ID,
     CONF_FLOW,
     CONF_VOLUME,
     DEVICE_CLASS_BATTERY,
@@ -32,13 +33,15 @@ from esphome.const import (
 )
 
 DEPENDENCIES = ['uart']
-AUTO_LOAD = ['binary_sensor', 'sensor']
+AUTO_LOAD = ['binary_sensor', 'meter_bus', 'sensor']
 MULTI_CONF = True
 
 CONF_COOLING_ENERGY = 'cooling_energy'
 CONF_HEATING_ENERGY = 'heating_energy'
 CONF_WATER_SUPPLY_TEMPERATURE = 'water_supply_temperature'
 CONF_BACKWATER_TEMPERATURE = 'backwater_temperature'
+CONF_DISCOVERY = 'discovery'
+CONF_ON_READING = 'on_reading'
 
 CONF_CONNECTIVITY_ERROR = 'connectivity_error'
 CONF_BATTERY_POWER_ALARM = 'battery_power_alarm'
@@ -49,6 +52,10 @@ CONF_TEMPERATURE_MORE_95_DEGREE = 'temperature_more_95_degree'
 
 sanext_ns = cg.esphome_ns.namespace('sanext_mono_cu')
 SanextMonoCU = sanext_ns.class_('SanextMonoCU', cg.PollingComponent, uart.UARTDevice)
+SanextReading = sanext_ns.struct('SanextReading')
+SanextReadingRef = SanextReading.operator('ref').operator('const')
+# Triggers
+SanextReadingTrigger = sanext_ns.class_('SanextReadingTrigger', automation.Trigger.template(SanextReadingRef))
 
 CONFIG_SCHEMA = (
     cv.Schema(
@@ -56,6 +63,11 @@ CONFIG_SCHEMA = (
             cv.GenerateID(): cv.declare_id(SanextMonoCU),
             cv.Optional(CONF_DEVICE_ID): cv.sub_device_id,
             cv.Optional(CONF_ADDRESS): cv.hex_uint64_t,
+            # search all meters on the bus by wildcard address, found addresses are kept in flash
+            cv.Optional(CONF_DISCOVERY, default=False): cv.boolean,
+            cv.Optional(CONF_ON_READING): automation.validate_automation({
+                cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(SanextReadingTrigger),
+            }),
 
             cv.Optional(CONF_COOLING_ENERGY): cv.maybe_simple_value(
                 sensor.sensor_schema(
@@ -179,6 +191,10 @@ async def to_code(config):
     await cg.register_component(var, config)
     if (address := config.get(CONF_ADDRESS)) is not None:
         cg.add(var.set_address(address))
+    cg.add(var.set_discovery(config[CONF_DISCOVERY], str(config[CONF_ID].id)))
+    for conf in config.get(CONF_ON_READING, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(trigger, [(SanextReadingRef, 'reading')], conf)
     for key in [CONF_COOLING_ENERGY, CONF_HEATING_ENERGY, CONF_POWER, CONF_FLOW, CONF_VOLUME, CONF_WATER_SUPPLY_TEMPERATURE, CONF_BACKWATER_TEMPERATURE]:
         if (sensor_config := config.get(key)):
             sens = await sensor.new_sensor(sensor_config)
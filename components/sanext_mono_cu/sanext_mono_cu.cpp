@@ -3,27 +3,73 @@
 namespace esphome {
 namespace sanext_mono_cu {
 
-#define LOG_WAIT_INTERVAL 1000
-#define CHUNK_SIZE 64
 #define READ_TIMEOUT 2000
+#define PROBE_TIMEOUT 500
+#define PROBE_INTER_BYTE_CHARS 10
+#define MAX_PHASES_PER_LOOP 8
 
 static const char *TAG = "sanext_mono_cu";
 //static const char *DIGITS = "0123456789ABCDEF";
 
 void SanextMonoCU::read_meter() {
-  ESP_LOGD(TAG, "Add to queue meter reading command");
-  this->commands_queue_.push(make_unique<SanextCommandReadMeter>());
+  if (this->discovery_ && !this->discovered_) {
+    if (this->probes_pending_ == 0)
+      this->discover();
+    return;
+  }
+  if (this->meters_.empty()) {
+    ESP_LOGD(TAG, "Add to queue meter reading command");
+    this->commands_queue_.push(make_unique<SanextCommandReadMeter>(this->address_));
+    return;
+  }
+  ESP_LOGD(TAG, "Add to queue reading commands for %d meters", this->meters_.size());
+  for (uint64_t address : this->meters_)
+    this->commands_queue_.push(make_unique<SanextCommandReadMeter>(address));
+}
+
+void SanextMonoCU::discover() {
+  ESP_LOGI(TAG, "Searching meters on the bus");
+  this->meters_.clear();
+  this->discovered_ = false;
+  this->probes_pending_ = 1;
+  this->commands_queue_.push(make_unique<SanextCommandProbe>(DEFAULT_ADDRESS, 0));
+}
+
+void SanextMonoCU::add_meter(uint64_t address) {
+  if (std::find(this->meters_.begin(), this->meters_.end(), address) != this->meters_.end())
+    return;
+  if (this->meters_.size() >= MAX_METERS) {
+    ESP_LOGW(TAG, "Too many meters, skip address 0x%llX", address);
+    return;
+  }
+  ESP_LOGI(TAG, "Meter address: 0x%llX", address);
+  this->meters_.push_back(address);
+  // sensors show first found meter unless address is configured
+  if (this->address_ == DEFAULT_ADDRESS)
+    this->address_ = address;
 }
 
 void SanextMonoCU::setup() {
   // read old unknown/unused data
   while (this->available())
     this->read();
+  if (this->discovery_) {
+    this->pref_ = global_preferences->make_preference<meters_pref_t>(fnv1_hash("sanext_mono_cu_" + this->pref_key_));
+    meters_pref_t pref{};
+    if (this->pref_.load(&pref) && pref.count > 0 && pref.count <= MAX_METERS) {
+      for (uint8_t i = 0; i < pref.count; i++)
+        this->add_meter(pref.addresses[i]);
+      this->discovered_ = true;
+    }
+  }
   delay(500);  // delay 0.5s after setup
 }
 
 void SanextMonoCU::dump_config() {
   ESP_LOGCONFIG(TAG, "SANEXT Mono CU: Address 0x%llX", this->address_);
+  ESP_LOGCONFIG(TAG, "  Discovery: %s", this->discovery_ ? "yes" : "no");
+  for (uint64_t address : this->meters_)
+    ESP_LOGCONFIG(TAG, "  Meter: 0x%llX", address);
   if (this->cooling_energy_sensor_)
     LOG_SENSOR("  ", "Cooling Energy Sensor: ", this->cooling_energy_sensor_);
   if (this->heating_energy_sensor_)
@@ -54,7 +100,7 @@ void SanextMonoCU::dump_config() {
 }
 
 void SanextMonoCU::update() {
-  if (this->phase_ != 0) {
+  if (this->phase_ != 0 || this->running_) {
     ESP_LOGW(TAG, "Skip update() coz previous was not finished!");
   } else {
     ESP_LOGV(TAG, "Time to Update");
@@ -63,6 +109,39 @@ void SanextMonoCU::update() {
 }
 
 void SanextMonoCU::loop() {
+  // phases which don't wait for anything are run one after another in the same loop
+  for (uint8_t i = 0; i < MAX_PHASES_PER_LOOP; i++) {
+    uint16_t phase = this->phase_;
+    this->run_phase();
+    if (this->phase_ == phase || this->sleep_time_ != 0)
+      break;
+  }
+}
+
+/* called by transaction for every received byte: response of command has fixed size after preamble */
+bool SanextMonoCU::receive_byte(uint8_t c) {
+  // package should start from 0xFE, 0xFE bytes
+  if (this->rx_bytes_received_ == 0 && c != 0xFE) {
+    ESP_LOGV(TAG, "Skip unknown first byte 0x%02X", c);
+    return false;
+  } else if (this->rx_bytes_received_ == 1 && c != 0xFE) {
+    ESP_LOGV(TAG, "Skip unknown second byte 0x%02X", c);
+    this->rx_bytes_received_ = 0;
+    return false;
+  } else if (this->rx_bytes_received_ == 2 && c == 0xFE) {
+    ESP_LOGV(TAG, "Skip third byte 0xFE");
+    return false;
+  }
+  // check sum is calculated while packet is received: from start byte to last byte before check sum
+  if (this->rx_bytes_received_ == 0)
+    this->rx_sum_.reset();
+  else if (this->rx_bytes_received_ >= 2 && this->rx_bytes_received_ + 2 < this->rx_bytes_needed_)
+    this->rx_sum_.update(c);
+  this->rx_buffer_[this->rx_bytes_received_++] = c;
+  return this->rx_bytes_received_ >= this->rx_bytes_needed_;
+}
+
+void SanextMonoCU::run_phase() {
   if (this->sleep_time_ != 0 && this->sleep_time_ > millis())
     return;
   else if (this->sleep_time_ != 0)
@@ -74,15 +153,18 @@ void SanextMonoCU::loop() {
       this->error_ = false;
       this->phase_ = 0;
       this->retry_count_ = 0;
+      this->cycle_bus_time_ = 0;
     }
     auto &command = this->commands_queue_.front();
     if (command == nullptr || this->process_command(command.get())) {
       this->commands_queue_.pop();
       this->phase_ = 0;
+      this->retry_count_ = 0;
     }
 
   } else if (this->running_ && this->commands_queue_.empty()) {
     this->running_ = false;
+    ESP_LOGD(TAG, "Bus time of all commands: %u ms", this->cycle_bus_time_);
     if (this->connectivity_error_sensor_)
       this->connectivity_error_sensor_->publish_state(this->error_);
   }
@@ -91,15 +173,6 @@ void SanextMonoCU::loop() {
 bool SanextMonoCU::process_command(SanextCommand *command) {
   switch (this->phase_) {
     case 1: {
-      // read old unknown/unused data
-      uint16_t unused_bytes;
-      for (unused_bytes = 0; unused_bytes < CHUNK_SIZE && this->available(); unused_bytes++)
-        this->read();
-      if (unused_bytes > 0) {
-        ESP_LOGV(TAG, "Command 0x%02X, phase %d: received %d unknown/unused bytes", command->code, this->phase_,
-                 unused_bytes);
-        return false;
-      }
       // prepare data to send
       this->tx_bytes_sending_ = 0;
       // header 0xFE,0xFE, start, type
@@ -108,8 +181,8 @@ bool SanextMonoCU::process_command(SanextCommand *command) {
       this->tx_buffer_[this->tx_bytes_sending_++] = 0x68;
       this->tx_buffer_[this->tx_bytes_sending_++] = 0x20;
       // address 7 bytes
-      for (uint8_t i = 0; i < 7; i++) {
-        uint64_t addr = (this->address_ >> (8 * i)) & 0xFF;
+      for (uint8_t i = 0; i < ADDRESS_SIZE; i++) {
+        uint64_t addr = (command->address >> (8 * i)) & 0xFF;
         this->tx_buffer_[this->tx_bytes_sending_++] = (uint8_t) addr;
       }
       // control code, length, d0, d1, SER
@@ -121,67 +194,42 @@ bool SanextMonoCU::process_command(SanextCommand *command) {
         this->tx_buffer_[this->tx_bytes_sending_++] = command->d1;
       this->tx_buffer_[this->tx_bytes_sending_++] = this->serial_++;
       // check sum
-      uint8_t csum = 0;
-      for (uint8_t i = 2; i < this->tx_bytes_sending_; i++)
-        csum += this->tx_buffer_[i];
+      uint8_t csum = meter_bus::Sum8::process(0, this->tx_buffer_ + 2, this->tx_bytes_sending_ - 2);
       this->tx_buffer_[this->tx_bytes_sending_++] = csum;
       // end
       this->tx_buffer_[this->tx_bytes_sending_++] = 0x16;
     } break;
 
     case 2: {
-      // sending data
+      // sending data, stale bytes are dropped by transaction
       ESP_LOGV(TAG, "Command 0x%02X, phase %d: sending %d bytes", command->code, this->phase_, this->tx_bytes_sending_);
-      this->write_array(this->tx_buffer_, this->tx_bytes_sending_);
-      this->flush();
       // will wait rx_bytes_needed bytes
       this->rx_bytes_needed_ = 13 + command->response_length + 2;
       this->rx_bytes_received_ = 0;
-      this->wait_time_ = millis() + READ_TIMEOUT;  // timeout N milliseconds
-    } break;
-
-    case 3: {
+      // several meters answering to probe at once give broken packet: it ends when line is silent
+      this->transaction_.set_inter_byte_chars(command->probe ? PROBE_INTER_BYTE_CHARS : 0);
+      this->transaction_.start(this->tx_buffer_, this->tx_bytes_sending_, command->probe ? PROBE_TIMEOUT : READ_TIMEOUT,
+                               this);
     } break;
 
     // receiving packet
-    case 4: {
-      // read data from UART with chunks
-      for (uint16_t i = 0; i < CHUNK_SIZE && this->rx_bytes_received_ < this->rx_bytes_needed_ && available(); i++) {
-        uint8_t c = this->read();
-        // package should start from 0xFE, 0xFE bytes
-        if (this->rx_bytes_received_ == 0 && c != 0xFE) {
-          ESP_LOGV(TAG, "Command 0x%02X, phase %d: skip unknown first byte 0x%02X", command->code, this->phase_, c);
-          continue;
-        } else if (this->rx_bytes_received_ == 1 && c != 0xFE) {
-          ESP_LOGV(TAG, "Command 0x%02X, phase %d: skip unknown second byte 0x%02X", command->code, this->phase_, c);
-          this->rx_bytes_received_ = 0;
-          continue;
-        } else if (this->rx_bytes_received_ == 2 && c == 0xFE) {
-          ESP_LOGV(TAG, "Command 0x%02X, phase %d: skip third byte 0xFE", command->code, this->phase_);
-          continue;
-        }
-        this->rx_buffer_[this->rx_bytes_received_++] = c;
-      }
-      // wait complete packet
-      if (this->rx_bytes_received_ < this->rx_bytes_needed_) {
-        unsigned long current_time = millis();
-        if (this->wait_time_ < current_time) {
-          ESP_LOGD(TAG, "Command 0x%02X, phase %d: timed out!", command->code, this->phase_);
-          return process_error(command);
-        } else {
-          if (this->log_time_ < current_time) {
-            ESP_LOGV(TAG, "Command 0x%02X, phase %d: waiting next %d bytes", command->code, this->phase_,
-                     this->rx_bytes_needed_ - this->rx_bytes_received_);
-            this->log_time_ = current_time + LOG_WAIT_INTERVAL;  // next log in LOG_WAIT_INTERVAL ms
-          }
-          return false;
-        }
+    case 3: {
+      meter_bus::TransactionStatus status = this->transaction_.poll();
+      if (status == meter_bus::TRANSACTION_BUSY)
+        return false;
+      this->bus_time_ = this->transaction_.get_duration() / 1000;
+      this->cycle_bus_time_ += this->bus_time_;
+      if (status == meter_bus::TRANSACTION_TIMEOUT) {
+        ESP_LOGD(TAG, "Command 0x%02X, phase %d: timed out (received %d of %d bytes)!", command->code, this->phase_,
+                 this->rx_bytes_received_, this->rx_bytes_needed_);
+        return process_error(command);
       }
-      ESP_LOGV(TAG, "Command 0x%02X, phase %d: received %d bytes", command->code, this->phase_, this->rx_bytes_received_);
+      ESP_LOGV(TAG, "Command 0x%02X, phase %d: received %d bytes in %u us", command->code, this->phase_,
+               this->rx_bytes_received_, this->transaction_.get_duration());
     } break;
 
     // validating packet
-    case 5: {
+    case 4: {
       // check fixed header
       if (this->rx_buffer_[0] != 0xFE || this->rx_buffer_[1] != 0xFE) {
         ESP_LOGW(TAG, "Command 0x%02X, phase %d got wrong header 0x%02X, 0x%02X (instead of 0xFE, 0xFE)", command->code, this->phase_,
@@ -208,9 +256,7 @@ bool SanextMonoCU::process_command(SanextCommand *command) {
       }
       // TODO check SER
       // check sum
-      uint8_t csum = 0;
-      for (uint8_t i = 2; i < this->rx_bytes_needed_ - 2; i++)
-        csum += this->rx_buffer_[i];
+      uint8_t csum = this->rx_sum_.value();
       if (this->rx_buffer_[this->rx_bytes_needed_ - 2] != csum) {
         ESP_LOGW(TAG, "Command 0x%02X, phase %d got wrong check sum 0x%02X (instead of 0x%02X)", command->code, this->phase_,
                  this->rx_buffer_[this->rx_bytes_needed_ - 2], csum);
@@ -224,22 +270,35 @@ bool SanextMonoCU::process_command(SanextCommand *command) {
       }
       // take address (7 bytes)
       uint64_t addr = 0UL;
-      for (uint8_t i = 0; i < 7; i++) {
+      for (uint8_t i = 0; i < ADDRESS_SIZE; i++) {
         addr += (uint64_t)(this->rx_buffer_[4 + i]) << (8 * i);
       }
+      if (command->probe) {
+        this->add_meter(addr);
+        return process_probe(command, true);
+      }
       if (this->address_ == DEFAULT_ADDRESS) {
         this->address_ = addr;
         ESP_LOGI(TAG, "Receive address: 0x%llX", this->address_);
-      } else if (this->address_ != addr) {
+      } else if (!address_matches(addr, command->address)) {
         ESP_LOGW(TAG, "Receive data from device with unkown address: 0x%llX", addr);
       }
       // everything OK; ready to process data
       ESP_LOGV(TAG, "Command 0x%02X, phase %d validation OK", command->code, this->phase_);
+      ESP_LOGD(TAG, "Meter 0x%llX: bus time %u ms", addr, this->bus_time_);
+      SanextReading reading;
+      this->parse_reading(addr, &reading);
+      this->on_reading_callback_.call(reading);
       this->process_phase_ = 0;
+      // sensors are published only for main meter
+      if (addr != this->address_) {
+        this->phase_ = 6;
+        return false;
+      }
     } break;
 
     // response processing
-    case 6: {
+    case 5: {
       if (command->code == SANEXT_ReadMeter) switch(++this->process_phase_) {
         case 1: {
           // ESP_LOGD(TAG, "Current cooling capacity: %.2f kWh (0x%02X)", (float)bcd32(&this->rx_buffer_[16]) * 0.01, this->rx_buffer_[20]);
@@ -313,7 +372,7 @@ bool SanextMonoCU::process_command(SanextCommand *command) {
     } break;
 
     // final phase
-    case 7:
+    case 6:
       ESP_LOGV(TAG, "Command 0x%02X, phase %d: command completed", command->code, this->phase_);
       return true;
   }
@@ -323,6 +382,8 @@ bool SanextMonoCU::process_command(SanextCommand *command) {
 }
 
 bool SanextMonoCU::process_error(SanextCommand *command, uint8_t error_code) {
+  if (command->probe)
+    return process_probe(command, false);
   // restart command if having retries
   if (++this->retry_count_ <= 3) {
     ESP_LOGD(TAG, "Error on command %02x. Doing retry %d...", command->code, this->retry_count_);
@@ -334,5 +395,59 @@ bool SanextMonoCU::process_error(SanextCommand *command, uint8_t error_code) {
   return true;
 }
 
+/* wildcard search: no answer - no meters match the address, valid answer - one meter, broken answer - several
+   meters answered together, so next address byte is fixed to each BCD value and these addresses are probed */
+bool SanextMonoCU::process_probe(SanextCommand *command, bool answered) {
+  // receiver drops bytes of garbled preamble, so any byte on the line is counted by transaction
+  if (!answered && this->transaction_.get_received() > 0) {
+    if (command->level < ADDRESS_SIZE) {
+      ESP_LOGD(TAG, "Probe 0x%llX: several meters answered, probing byte %d", command->address, command->level);
+      uint64_t base = command->address & ~(0xFFULL << (8 * command->level));
+      for (uint8_t value = 0; value < 100; value++) {
+        uint64_t bcd = ((value / 10) << 4) | (value % 10);
+        this->commands_queue_.push(make_unique<SanextCommandProbe>(base | (bcd << (8 * command->level)), command->level + 1));
+        this->probes_pending_++;
+      }
+    } else {
+      ESP_LOGW(TAG, "Probe 0x%llX: broken answer", command->address);
+    }
+  }
+  if (--this->probes_pending_ == 0) {
+    ESP_LOGI(TAG, "Found %d meters", this->meters_.size());
+    this->discovered_ = true;
+    if (this->discovery_) {
+      meters_pref_t pref{};
+      pref.count = this->meters_.size();
+      std::copy(this->meters_.begin(), this->meters_.end(), pref.addresses);
+      this->pref_.save(&pref);
+    }
+    this->read_meter();
+  }
+  return true;
+}
+
+bool SanextMonoCU::address_matches(uint64_t address, uint64_t pattern) {
+  for (uint8_t i = 0; i < ADDRESS_SIZE; i++) {
+    uint8_t byte = (pattern >> (8 * i)) & 0xFF;
+    if (byte != WILDCARD_BYTE && byte != ((address >> (8 * i)) & 0xFF))
+      return false;
+  }
+  return true;
+}
+
+void SanextMonoCU::parse_reading(uint64_t address, SanextReading *reading) {
+  const uint8_t *data = this->rx_buffer_;
+  reading->address = address;
+  reading->cooling_energy = data[20] == 0x05 ? (float) bcd32(&data[16]) * 0.01 : NAN;
+  reading->heating_energy = data[25] == 0x05 ? (float) bcd32(&data[21]) * 0.01 : NAN;
+  reading->power = data[30] == 0x17 ? (float) bcd32(&data[26]) * 0.01 : NAN;
+  reading->flow = data[35] == 0x35 ? (float) bcd32(&data[31]) * 0.01 : NAN;
+  reading->volume = data[40] == 0x2C ? (float) bcd32(&data[36]) * 0.01 : NAN;
+  reading->water_supply_temperature = (float) bcd24(&data[41]) * 0.01;
+  reading->backwater_temperature = (float) bcd24(&data[44]) * 0.01;
+  reading->status = data[58];
+  reading->bus_time = this->bus_time_;
+}
+
 }  // namespace sanext_mono_cu
 }  // namespace esphome
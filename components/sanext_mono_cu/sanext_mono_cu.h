@@ -1,11 +1,17 @@
 #pragma once
 
 #include "esphome/components/binary_sensor/binary_sensor.h"
+#include "esphome/components/meter_bus/checksum.h"
+#include "esphome/components/meter_bus/meter_bus.h"
 #include "esphome/components/sensor/sensor.h"
 #include "esphome/components/uart/uart.h"
+#include "esphome/core/automation.h"
 #include "esphome/core/component.h"
+#include "esphome/core/preferences.h"
+#include <algorithm>
 #include <memory>
 #include <queue>
+#include <vector>
 
 namespace esphome {
 namespace sanext_mono_cu {
@@ -13,24 +19,55 @@ namespace sanext_mono_cu {
 #define TX_BUFFER_SIZE 64
 #define RX_BUFFER_SIZE 192
 #define DEFAULT_ADDRESS 0xAAAAAAAAAAAAAAUL
+#define ADDRESS_SIZE 7
+#define WILDCARD_BYTE 0xAA
+#define MAX_METERS 16
+
 class SanextCommand {
  public:
   SanextCommand(uint8_t code_, uint8_t request_length_, uint8_t response_length_, uint8_t d0_ = 0, uint8_t d1_ = 0)
       : code(code_), request_length(request_length_), response_length(response_length_), d0(d0_), d1(d1_) {}
   uint8_t code, request_length, response_length, d0, d1;
+  uint64_t address{DEFAULT_ADDRESS};
+  bool probe{false};   /* discovery: several meters can answer to wildcard address */
+  uint8_t level{0};    /* discovery: number of fixed low address bytes, others are WILDCARD_BYTE */
 };
 
 #define SANEXT_ReadMeter 0x01
 
 class SanextCommandReadMeter : public SanextCommand {
  public:
-  SanextCommandReadMeter() : SanextCommand(SANEXT_ReadMeter, 3, 0x2E, 0x1F, 0x90) {}
+  SanextCommandReadMeter(uint64_t address_ = DEFAULT_ADDRESS) : SanextCommand(SANEXT_ReadMeter, 3, 0x2E, 0x1F, 0x90) {
+    address = address_;
+  }
+};
+
+class SanextCommandProbe : public SanextCommandReadMeter {
+ public:
+  SanextCommandProbe(uint64_t address_, uint8_t level_) : SanextCommandReadMeter(address_) {
+    probe = true;
+    level = level_;
+  }
+};
+
+/* values of one meter passed to on_reading automations */
+struct SanextReading {
+  uint64_t address;
+  float cooling_energy, heating_energy, power, flow, volume;
+  float water_supply_temperature, backwater_temperature;
+  uint8_t status;
+  uint32_t bus_time;  /* milliseconds of request and response */
 };
 
+typedef struct {
+  uint8_t count;
+  uint64_t addresses[MAX_METERS];
+} meters_pref_t;
+
 
-class SanextMonoCU : public PollingComponent, public uart::UARTDevice {
+class SanextMonoCU : public PollingComponent, public uart::UARTDevice, public meter_bus::FrameReceiver {
  public:
-  SanextMonoCU(uart::UARTComponent *uart) : uart::UARTDevice(uart) {}
+  SanextMonoCU(uart::UARTComponent *uart) : uart::UARTDevice(uart), transaction_(uart) {}
 
   static uint8_t bcd8(const uint8_t data) { return (data & 0x0f) + 10 * ((data >> 4) & 0x0f); };
   static uint16_t bcd16(const uint8_t *data) { return bcd8(data[0]) + 100 * bcd8(data[1]); };
@@ -45,6 +82,7 @@ class SanextMonoCU : public PollingComponent, public uart::UARTDevice {
   void dump_config() override;
   void update() override;
   void loop() override;
+  bool receive_byte(uint8_t c) override;
 
   void set_cooling_energy_sensor(sensor::Sensor *sensor) { this->cooling_energy_sensor_ = sensor; }
   void set_heating_energy_sensor(sensor::Sensor *sensor) { this->heating_energy_sensor_ = sensor; }
@@ -61,12 +99,26 @@ class SanextMonoCU : public PollingComponent, public uart::UARTDevice {
   void set_temperature_more_95_degree_sensor(binary_sensor::BinarySensor *sensor) { this->temperature_more_95_degree_sensor_ = sensor; }
 
   void set_address(uint64_t address) { this->address_ = address; };
+  void set_discovery(bool discovery, const std::string &key) {
+    this->discovery_ = discovery;
+    this->pref_key_ = key;
+  }
   void read_meter();
+  /* forget cached addresses and search meters on the bus again */
+  void discover();
+  void add_on_reading_callback(std::function<void(const SanextReading &)> &&callback) {
+    this->on_reading_callback_.add(std::move(callback));
+  }
 
  protected:
   void delay(uint32_t delay_ms) { this->sleep_time_ = millis() + delay_ms; }
+  void run_phase();
   bool process_command(SanextCommand *command);
   bool process_error(SanextCommand *command, uint8_t error_code = 0x01);
+  bool process_probe(SanextCommand *command, bool answered);
+  void add_meter(uint64_t address);
+  void parse_reading(uint64_t address, SanextReading *reading);
+  static bool address_matches(uint64_t address, uint64_t pattern);
 
  private:
   sensor::Sensor *cooling_energy_sensor_{nullptr}, *heating_energy_sensor_{nullptr}, *power_sensor_{nullptr}, *flow_sensor_{nullptr},
@@ -77,10 +129,26 @@ class SanextMonoCU : public PollingComponent, public uart::UARTDevice {
   bool running_{false}, error_{false};
   uint64_t address_{DEFAULT_ADDRESS};
   uint16_t phase_{0}, process_phase_{0}, retry_count_{0};
-  unsigned long sleep_time_{0}, wait_time_{0}, log_time_{0};
+  unsigned long sleep_time_{0};
   uint16_t tx_bytes_sending_{0}, rx_bytes_needed_{0}, rx_bytes_received_{0};
   uint8_t tx_buffer_[TX_BUFFER_SIZE], rx_buffer_[RX_BUFFER_SIZE];
   uint8_t serial_{0};
+  bool discovery_{false}, discovered_{false};
+  std::string pref_key_;
+  std::vector<uint64_t> meters_;
+  uint16_t probes_pending_{0};
+  uint32_t bus_time_{0}, cycle_bus_time_{0};
+  ESPPreferenceObject pref_;
+  CallbackManager<void(const SanextReading &)> on_reading_callback_{};
+  meter_bus::Transaction transaction_;
+  meter_bus::Sum8 rx_sum_;
+};
+
+class SanextReadingTrigger : public Trigger<const SanextReading &> {
+ public:
+  explicit SanextReadingTrigger(SanextMonoCU *parent) {
+    parent->add_on_reading_callback([this](const SanextReading &reading) { this->trigger(reading); });
+  }
 };
 
 }  // namespace sanext_mono_cu